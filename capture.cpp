@@ -0,0 +1,157 @@
+/**
+ ***********************************************************************
+ * @file   capture.cpp
+ * @author Juraj Grabovac (jgrabovac2@gmail.com)
+ * @date   19/10/2026
+ * @brief  See capture.h
+ ***********************************************************************
+*/
+
+
+/*----- Includes -----*/
+#include "capture.h"
+
+namespace {
+
+constexpr char kCaptureMagic[8] = {'P', 'S', 'C', 'A', 'P', '0', '0', '1'};
+constexpr auto kMaxBufferSize = 64 * 1024;
+constexpr auto kMaxMessageSize = 16 * 1024 * 1024;
+
+/*----- Helper Functions -----*/
+/**
+ * @brief Append variable length unsigned number, 7 bits per byte.
+ *
+ * @param [in] value - number
+ * @param [out] output - output buffer
+ */
+void write_varint(uint64_t value, std::string& output)
+{
+    while (value >= 0x80)
+    {
+        output += (char)((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+
+    output += (char)value;
+}
+
+}  // namespace
+
+namespace capture_handler {
+
+CaptureWriter::~CaptureWriter() {
+    Close();
+}
+
+bool CaptureWriter::Open(const std::string& path){
+    _file.open(path, std::ios::binary | std::ios::trunc);
+    if(!_file.is_open()){
+        return false;
+    }
+
+    _file.write(kCaptureMagic, sizeof(kCaptureMagic));
+    _start_time = std::chrono::steady_clock::now();
+    _last_timestamp_us = 0;
+
+    return true;
+}
+
+void CaptureWriter::Record(uint32_t connection_id, capture_record_type type, const std::string& message){
+    if(!_file.is_open()){
+        return;
+    }
+
+    uint64_t timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - _start_time).count();
+
+    write_varint(timestamp_us - _last_timestamp_us, _buffer);
+    write_varint(connection_id, _buffer);
+    _buffer += (char)type;
+    write_varint(message.size(), _buffer);
+    _buffer += message;
+
+    _last_timestamp_us = timestamp_us;
+
+    // Records are written in blocks, capture must not slow down server thread
+    if(_buffer.size() >= kMaxBufferSize){
+        Flush();
+    }
+}
+
+void CaptureWriter::Close(){
+    if(!_file.is_open()){
+        return;
+    }
+
+    Flush();
+    _file.close();
+}
+
+void CaptureWriter::Flush(){
+    _file.write(_buffer.data(), _buffer.size());
+    _buffer.clear();
+}
+
+bool CaptureReader::Open(const std::string& path){
+    char magic[sizeof(kCaptureMagic)];
+
+    _file.open(path, std::ios::binary);
+    if(!_file.is_open()){
+        return false;
+    }
+
+    if(!_file.read(magic, sizeof(magic)) || (std::string(magic, sizeof(magic)) != std::string(kCaptureMagic, sizeof(kCaptureMagic)))){
+        _file.close();
+        return false;
+    }
+
+    _timestamp_us = 0;
+
+    return true;
+}
+
+bool CaptureReader::Next(capture_record& record){
+    uint64_t delta = 0, connection_id = 0, length = 0;
+    char type = 0;
+
+    if(!ReadVarint(delta) || !ReadVarint(connection_id) || !_file.get(type) || !ReadVarint(length)){
+        return false;
+    }
+
+    if(length > kMaxMessageSize){
+        return false;
+    }
+
+    record.message.resize(length);
+    if((length > 0) && !_file.read(&record.message[0], length)){
+        return false;
+    }
+
+    _timestamp_us += delta;
+    record.timestamp_us = _timestamp_us;
+    record.connection_id = (uint32_t)connection_id;
+    record.type = (capture_record_type)type;
+
+    return true;
+}
+
+bool CaptureReader::ReadVarint(uint64_t& value){
+    char byte = 0;
+    int shift = 0;
+
+    value = 0;
+
+    do
+    {
+        if((shift > 63) || !_file.get(byte)){
+            return false;
+        }
+
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while(byte & 0x80);
+
+    return true;
+}
+
+}  // namespace capture_handler
@@ -0,0 +1,135 @@
+/**
+ * @file capture.h
+ *
+ * @brief Implementation of inbound command capture and trace reading.
+ *
+ * Capture records every command received by the server, as parsed by the
+ * frame reader, together with connection events. Trace starts with a
+ * magic header and continues with records:
+ *   varint time delta (us) | varint connection id | uint8 type | varint length | bytes
+ * Time is stored as delta to the previous record, so a record of a short
+ * command usually takes only a few bytes over the command itself.
+ *
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace capture_handler {
+
+/*----- Enums and Structures -----*/
+enum capture_record_type : uint8_t
+{
+    CAPTURE_CONNECT,
+    CAPTURE_MESSAGE,
+    CAPTURE_DISCONNECT
+};
+
+struct capture_record
+{
+    // Microseconds since start of capture
+    uint64_t timestamp_us;
+    uint32_t connection_id;
+    capture_record_type type;
+    std::string message;
+};
+
+class CaptureWriter {
+ public:
+  /**
+   * @brief Constructor
+   */
+  CaptureWriter() = default;
+
+  /**
+   * @brief Destructor
+   */
+  ~CaptureWriter();
+
+  /**
+   * @brief Create trace file, capture time starts now.
+   *
+   * @param [in] path - trace file path
+   *
+   * @return bool - true on success, false otherwise.
+   */
+  bool Open(const std::string& path);
+
+  /**
+   * @brief Check if capture is running.
+   *
+   * @return bool - true if trace file is open, false otherwise.
+   */
+  bool IsOpen() const { return _file.is_open(); }
+
+  /**
+   * @brief Append record to trace.
+   *
+   * @param [in] connection_id - connection id
+   * @param [in] type - record type
+   * @param [in] message - command without terminating null character, empty for connection events
+   */
+  void Record(uint32_t connection_id, capture_record_type type, const std::string& message = std::string());
+
+  /**
+   * @brief Write buffered records and close trace file.
+   */
+  void Close();
+
+ private:
+  /**
+   * @brief Write buffered records to trace file.
+   */
+  void Flush();
+
+  std::ofstream _file;
+  std::string _buffer;
+  std::chrono::steady_clock::time_point _start_time;
+  uint64_t _last_timestamp_us = 0;
+};
+
+class CaptureReader {
+ public:
+  /**
+   * @brief Constructor
+   */
+  CaptureReader() = default;
+
+  /**
+   * @brief Open trace file and check its header.
+   *
+   * @param [in] path - trace file path
+   *
+   * @return bool - true on success, false otherwise.
+   */
+  bool Open(const std::string& path);
+
+  /**
+   * @brief Read next record.
+   *
+   * @param [out] record - record
+   *
+   * @return bool - true if record is read, false at the end of trace or on truncated record.
+   */
+  bool Next(capture_record& record);
+
+ private:
+  /**
+   * @brief Read variable length unsigned number.
+   *
+   * @param [out] value - number
+   *
+   * @return bool - true on success, false at the end of trace.
+   */
+  bool ReadVarint(uint64_t& value);
+
+  std::ifstream _file;
+  uint64_t _timestamp_us = 0;
+};
+
+}  // namespace capture_handler
@@ -15,6 +15,7 @@ namespace {
 
 constexpr auto kENDL = 13;
 constexpr auto kBS = 8;
+constexpr auto kReceiveBufferSize = 256 * 1024;
 
 }  // namespace
 
@@ -82,7 +83,7 @@ void ClientHandler::ConnectToServer(){
 	hint.sin_family = AF_INET;
     hint.sin_addr.s_addr = inet_addr("127.0.0.1");
     
-    string command, client_name, userInput;
+    string command, client_name, options, userInput;
     int connResult = SOCKET_ERROR;
     int recv_port;
 
@@ -94,8 +95,9 @@ void ClientHandler::ConnectToServer(){
         getline(cin, userInput);
         istringstream iss(userInput);
 
-        // Parse input stream to command, port and client name
-        iss >> command >> recv_port >> client_name;
+        // Parse input stream to command, port, client name and optional LZ4 option
+        options.clear();
+        iss >> command >> recv_port >> client_name >> options;
         
         // Check command
         if(command.compare("CONNECT") != 0)
@@ -119,6 +121,26 @@ void ClientHandler::ConnectToServer(){
             }
         }
     } while(connResult != 0);
+    
+    _port_num = recv_port;
+    _client_name = client_name;
+    
+    // Send client name and capabilities, shared memory transport only if server is on the same host
+    string capabilities;
+    if (hint.sin_addr.s_addr == htonl(INADDR_LOOPBACK))
+    {
+        capabilities = "SHM";
+    }
+    if (options.compare("LZ4") == 0)
+    {
+        capabilities += capabilities.empty() ? "LZ4" : ",LZ4";
+    }
+    
+    string ConnectMsg = "CONNECT " + client_name + " " + capabilities;
+    if (!SendToServer(ConnectMsg))
+    {
+        cerr << "Can't send CONNECT, Err #" << WSAGetLastError() << endl;
+    }
 }
 
 void ClientHandler::ClientThread(){
@@ -137,9 +159,6 @@ void ClientHandler::ClientThread(){
     int sel, numRead;
     int endl_flag = 0;   
 
-    char in[255];
-    memset(&in, 0, 255);
-
     // Definition of std input handler and record
     HANDLE hIn;
     INPUT_RECORD input;
@@ -168,9 +187,8 @@ void ClientHandler::ClientThread(){
             // Clear read set
             FD_CLR(_sock, &read_flags);
 
-            // Read message from server
-            memset(&in, 0, 255);
-            numRead = recv(_sock, in, 255, 0);
+            // Read everything available directly into frame reader buffer
+            numRead = recv(_sock, _frame_reader.WriteBuffer(kReceiveBufferSize), kReceiveBufferSize, 0);
             
             if(numRead <= 0) 
             {
@@ -178,11 +196,38 @@ void ClientHandler::ClientThread(){
                 closesocket(_sock);
                 break;
             }
-            else if(in[0] != '\0')
+            else
             {
-                cout << in;
+                // Messages may be split between reads or arrive together, all complete ones are handled in place
+                string_view message;
+                _frame_reader.Commit(numRead);
+                
+                while(_frame_reader.Next(message))
+                {
+                    HandleServerMessage(message);
+                }
+                
+                FlushOutput();
+                
+                if(_frame_reader.Corrupted())
+                {
+                    printf("\nInvalid frame, closing socket");
+                    closesocket(_sock);
+                    break;
+                }
+                
+                // All messages of this read are acknowledged together
+                if(!SendAcknowledgements())
+                {
+                    printf("\nSend failed, closing socket");
+                    closesocket(_sock);
+                    break;
+                }
             }
         }
+        
+        // Messages of topics delivered over shared memory
+        PollShmRings();
 
         /* ----- Receiving User Input ----- */
         // Get std input handler and check is there any input
@@ -232,7 +277,12 @@ void ClientHandler::ClientThread(){
             FD_CLR(_sock, &write_flags);
             
             // Send message to server
-            send(_sock, userInput.c_str(), 255, 0);
+            if(!SendToServer(userInput))
+            {
+                printf("\nSend failed, closing socket");
+                closesocket(_sock);
+                break;
+            }
             userInput.clear();
             
             // Reset end line flag to enable receiving new user input
@@ -241,4 +291,161 @@ void ClientHandler::ClientThread(){
     }
 }
 
+bool ClientHandler::SendToServer(const std::string& message){
+    const char *data = message.c_str();
+    int length = message.size() + 1;
+    
+    while(length > 0)
+    {
+        int bytesOut = send(_sock, data, length, 0);
+        
+        if(bytesOut == SOCKET_ERROR)
+        {
+            if(WSAGetLastError() != WSAEWOULDBLOCK)
+            {
+                return false;
+            }
+            
+            // Socket is non-blocking, wait until it is writable again
+            fd_set write_flags;
+            FD_ZERO(&write_flags);
+            FD_SET(_sock, &write_flags);
+            select(_sock+1, nullptr, &write_flags, nullptr, nullptr);
+            continue;
+        }
+        
+        data += bytesOut;
+        length -= bytesOut;
+    }
+    
+    return true;
+}
+
+bool ClientHandler::HandleQosMessage(std::string_view message){
+    string tag, topic_label, topic, seq_label;
+    uint32_t seq = 0;
+    
+    istringstream iss{string(message)};
+    iss >> tag >> topic_label >> topic >> seq_label >> seq;
+    
+    // Acknowledgement is sent for duplicates too, previous one may have been lost
+    _qos_pending_acks[topic] = max(_qos_pending_acks[topic], seq);
+    
+    auto it = _qos_received.find(topic);
+    if((it != _qos_received.end()) && (seq <= it->second))
+    {
+        return false;
+    }
+    
+    // Server skips sequence numbers of messages dropped from its full queue
+    if((it != _qos_received.end()) && (seq > it->second + 1))
+    {
+        cerr << "QoS messages lost, Topic: " << topic << " Count: " << (seq - it->second - 1) << endl;
+    }
+    
+    _qos_received[topic] = seq;
+    
+    return true;
+}
+
+bool ClientHandler::SendAcknowledgements(){
+    for(const auto& ack : _qos_pending_acks)
+    {
+        if(!SendToServer("ACK " + ack.first + " " + to_string(ack.second)))
+        {
+            return false;
+        }
+    }
+    
+    _qos_pending_acks.clear();
+    
+    return true;
+}
+
+void ClientHandler::HandleServerMessage(std::string_view message){
+    string transport, mode, topic, segment;
+    uint64_t start_seq = 0;
+    
+    // Messages of acknowledged subscriptions carry sequence number
+    if((message.compare(0, 17, "[Message] Topic: ") == 0) && (message.find(" Seq: ") != string_view::npos))
+    {
+        if(HandleQosMessage(message))
+        {
+            DeliverMessage(message);
+        }
+        return;
+    }
+    
+    // Transport messages are handled by client, all other messages are delivered
+    if(message.compare(0, 11, "[Transport]") != 0)
+    {
+        DeliverMessage(message);
+        return;
+    }
+    
+    istringstream iss{string(message)};
+    iss >> transport >> mode >> topic >> segment >> start_seq;
+    
+    if(mode.compare("LZ4") == 0)
+    {
+        // Server sends binary frames after confirming compression
+        _frame_reader.SetBinary(true);
+    }
+    else if(mode.compare("SHM") == 0)
+    {
+        if(!_shm_rings[topic].Open(segment, start_seq))
+        {
+            _shm_rings.erase(topic);
+            cerr << "Can't open shared memory ring for topic " << topic << endl;
+        }
+    }
+    else
+    {
+        _shm_rings.erase(topic);
+    }
+}
+
+void ClientHandler::PollShmRings(){
+    string message;
+    
+    for(auto& ring : _shm_rings)
+    {
+        shm_transport::shm_read_result result;
+        
+        while((result = ring.second.Read(message)) != shm_transport::SHM_READ_EMPTY)
+        {
+            if(result == shm_transport::SHM_READ_OVERRUN)
+            {
+                cerr << "Shared memory messages lost, Topic: " << ring.first << endl;
+                continue;
+            }
+            
+            DeliverMessage(message);
+        }
+    }
+    
+    FlushOutput();
+}
+
+void ClientHandler::DeliverMessage(std::string_view message){
+    if(_message_callback)
+    {
+        _message_callback(message);
+        return;
+    }
+    
+    _output.append(message.data(), message.size());
+}
+
+void ClientHandler::FlushOutput(){
+    if(_output.empty())
+    {
+        return;
+    }
+    
+    cout.write(_output.data(), _output.size());
+    cout.flush();
+    _output.clear();
+}
+
 } // namespace client_handler
\ No newline at end of file
@@ -7,15 +7,25 @@
 
 #pragma once
 
+#include <functional>
 #include <iostream>
+#include <map>
 #include <sstream>
+#include <string>
+#include <string_view>
 #include <WS2tcpip.h>
 #include <thread>
 
+#include "frame.h"
+#include "shm.h"
+
 namespace client_handler {
 
 class ClientHandler {
  public:
+  // Callback gets view of received message, valid only during the call
+  using message_callback = std::function<void(std::string_view message)>;
+
   /**
    * @brief Constructor
    */
@@ -33,6 +43,13 @@ class ClientHandler {
    */
   bool Init();
 
+  /**
+   * @brief Set callback for received messages, messages are printed if it is not set. Has to be set before Init().
+   *
+   * @param [in] callback - message callback
+   */
+  void SetMessageCallback(message_callback callback) { _message_callback = std::move(callback); }
+
  private:
   /**
    * @brief Initialize WinSock.
@@ -58,8 +75,68 @@ class ClientHandler {
    */
   void ClientThread();
 
+  /**
+   * @brief Send message with terminating null character to server, waits while socket is not writable.
+   *
+   * @param [in] message - message without terminating null character
+   *
+   * @return bool - true on success, false on connection error.
+   */
+  bool SendToServer(const std::string& message);
+
+  /**
+   * @brief Handle message of acknowledged subscription, duplicates of retransmitted messages are dropped.
+   *
+   * @param [in] message - message without terminating null character
+   *
+   * @return bool - true if message should be printed, false if it is a duplicate.
+   */
+  bool HandleQosMessage(std::string_view message);
+
+  /**
+   * @brief Send one cumulative acknowledgement per topic for messages received since the last call.
+   *
+   * @return bool - true on success, false on connection error.
+   */
+  bool SendAcknowledgements();
+
+  /**
+   * @brief Handle complete message received from server.
+   *
+   * @param [in] message - message without terminating null character
+   */
+  void HandleServerMessage(std::string_view message);
+
+  /**
+   * @brief Pass message to callback, or add it to console output if callback is not set.
+   *
+   * @param [in] message - message without terminating null character
+   */
+  void DeliverMessage(std::string_view message);
+
+  /**
+   * @brief Print console output collected since the last call with one write.
+   */
+  void FlushOutput();
+
+  /**
+   * @brief Read and print new messages from shared memory topic rings.
+   */
+  void PollShmRings();
+
   SOCKET _sock;
   std::thread _client_thread;
+
+  int _port_num;
+  std::string _client_name;
+  frame_handler::FrameReader _frame_reader;
+  std::map<std::string, shm_transport::ShmRing> _shm_rings;
+  message_callback _message_callback;
+  std::string _output;
+
+  // Last received sequence number and sequence number waiting for acknowledgement per topic
+  std::map<std::string, uint32_t> _qos_received;
+  std::map<std::string, uint32_t> _qos_pending_acks;
 };
 
 }  // namespace client_handler
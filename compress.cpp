@@ -0,0 +1,234 @@
+/**
+ ***********************************************************************
+ * @file   compress.cpp
+ * @author Juraj Grabovac (jgrabovac2@gmail.com)
+ * @date   19/10/2026
+ * @brief  See compress.h
+ ***********************************************************************
+*/
+
+
+/*----- Includes -----*/
+#include "compress.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+constexpr auto kMinMatch = 4;
+constexpr auto kLastLiterals = 5;
+constexpr auto kMatchFindLimit = 12;
+constexpr auto kMaxOffset = 65535;
+constexpr auto kHashLog = 12;
+
+/*----- Helper Functions -----*/
+/**
+ * @brief Read 4 bytes from unaligned address.
+ *
+ * @param [in] data - pointer to data
+ *
+ * @return uint32_t - read value.
+ */
+uint32_t read32(const char *data)
+{
+    uint32_t value;
+
+    memcpy(&value, data, sizeof(value));
+
+    return value;
+}
+
+/**
+ * @brief Hash of 4 bytes sequence used as index in match table.
+ *
+ * @param [in] sequence - 4 bytes sequence
+ *
+ * @return uint32_t - hash.
+ */
+uint32_t hash_sequence(uint32_t sequence)
+{
+    return (sequence * 2654435761U) >> (32 - kHashLog);
+}
+
+/**
+ * @brief Write LZ4 length extension bytes.
+ *
+ * @param [in] length - remaining length after 4 bit token field
+ * @param [out] output - compressed block
+ */
+void write_length(size_t length, std::string& output)
+{
+    while (length >= 255)
+    {
+        output += (char)255;
+        length -= 255;
+    }
+
+    output += (char)length;
+}
+
+/**
+ * @brief Write LZ4 sequence, match length 0 writes last literals only.
+ *
+ * @param [in] literals - pointer to literals
+ * @param [in] literal_length - number of literals
+ * @param [in] offset - match offset
+ * @param [in] match_length - match length
+ * @param [out] output - compressed block
+ */
+void write_sequence(const char *literals, size_t literal_length, size_t offset, size_t match_length, std::string& output)
+{
+    size_t match_code = (match_length > 0) ? (match_length - kMinMatch) : 0;
+    unsigned char token = (unsigned char)(((literal_length < 15) ? literal_length : 15) << 4);
+
+    token |= (unsigned char)((match_code < 15) ? match_code : 15);
+    output += (char)token;
+
+    if (literal_length >= 15)
+    {
+        write_length(literal_length - 15, output);
+    }
+
+    output.append(literals, literal_length);
+
+    if (match_length == 0)
+    {
+        return;
+    }
+
+    output += (char)(offset & 0xFF);
+    output += (char)((offset >> 8) & 0xFF);
+
+    if (match_code >= 15)
+    {
+        write_length(match_code - 15, output);
+    }
+}
+
+/**
+ * @brief Read LZ4 length extension bytes.
+ *
+ * @param [in,out] pos - position in compressed block
+ * @param [in] end - compressed block end
+ * @param [in,out] length - length from 4 bit token field
+ *
+ * @return bool - true on success, false if block is truncated.
+ */
+bool read_length(const unsigned char *&pos, const unsigned char *end, size_t& length)
+{
+    unsigned char byte;
+
+    do
+    {
+        if (pos >= end)
+        {
+            return false;
+        }
+
+        byte = *pos++;
+        length += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+}  // namespace
+
+namespace compress_handler {
+
+void Lz4Compress(const char *data, size_t length, std::string& output){
+    output.clear();
+    output.reserve(length + length / 255 + 16);
+
+    size_t anchor = 0;
+
+    if(length > kMatchFindLimit){
+        std::vector<int32_t> table(1 << kHashLog, -1);
+        size_t limit = length - kMatchFindLimit;
+        size_t pos = 0;
+
+        while(pos < limit){
+            uint32_t sequence = read32(data + pos);
+            uint32_t hash = hash_sequence(sequence);
+            int32_t candidate = table[hash];
+
+            table[hash] = (int32_t)pos;
+
+            if((candidate < 0) || (pos - candidate > kMaxOffset) || (read32(data + candidate) != sequence)){
+                pos++;
+                continue;
+            }
+
+            // Extend match, last literals must stay uncompressed
+            size_t match_length = kMinMatch;
+            while((pos + match_length < length - kLastLiterals) && (data[candidate + match_length] == data[pos + match_length])){
+                match_length++;
+            }
+
+            write_sequence(data + anchor, pos - anchor, pos - candidate, match_length, output);
+
+            pos += match_length;
+            anchor = pos;
+        }
+    }
+
+    write_sequence(data + anchor, length - anchor, 0, 0, output);
+}
+
+bool Lz4Decompress(const char *data, size_t length, size_t raw_length, std::string& output){
+    const unsigned char *pos = (const unsigned char *)data;
+    const unsigned char *end = pos + length;
+
+    output.clear();
+    output.reserve(raw_length);
+
+    while(pos < end){
+        unsigned char token = *pos++;
+        size_t literal_length = token >> 4;
+
+        if((literal_length == 15) && !read_length(pos, end, literal_length)){
+            return false;
+        }
+
+        if(((size_t)(end - pos) < literal_length) || (output.size() + literal_length > raw_length)){
+            return false;
+        }
+
+        output.append((const char *)pos, literal_length);
+        pos += literal_length;
+
+        // Last sequence has literals only
+        if(pos == end){
+            break;
+        }
+
+        if(end - pos < 2){
+            return false;
+        }
+
+        size_t offset = pos[0] | (pos[1] << 8);
+        pos += 2;
+
+        size_t match_length = token & 0x0F;
+        if((match_length == 15) && !read_length(pos, end, match_length)){
+            return false;
+        }
+        match_length += kMinMatch;
+
+        if((offset == 0) || (offset > output.size()) || (output.size() + match_length > raw_length)){
+            return false;
+        }
+
+        // Match may overlap with bytes it produces, copy byte by byte
+        size_t match_pos = output.size() - offset;
+        for(size_t i = 0; i < match_length; ++i){
+            output += output[match_pos + i];
+        }
+    }
+
+    return (output.size() == raw_length);
+}
+
+}  // namespace compress_handler
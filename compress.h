@@ -0,0 +1,38 @@
+/**
+ * @file compress.h
+ *
+ * @brief Implementation of LZ4 block format compression.
+ *
+ * Compressed output is a standard LZ4 block, so it can be decoded by any
+ * LZ4 implementation that knows the uncompressed size.
+ *
+ */
+
+#pragma once
+
+#include <string>
+
+namespace compress_handler {
+
+/**
+ * @brief Compress data to LZ4 block.
+ *
+ * @param [in] data - data to compress
+ * @param [in] length - data length
+ * @param [out] output - compressed block
+ */
+void Lz4Compress(const char *data, size_t length, std::string& output);
+
+/**
+ * @brief Decompress LZ4 block.
+ *
+ * @param [in] data - compressed block
+ * @param [in] length - compressed block length
+ * @param [in] raw_length - uncompressed data length
+ * @param [out] output - uncompressed data
+ *
+ * @return bool - true on success, false if block is corrupted.
+ */
+bool Lz4Decompress(const char *data, size_t length, size_t raw_length, std::string& output);
+
+}  // namespace compress_handler
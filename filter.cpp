@@ -0,0 +1,343 @@
+/**
+ ***********************************************************************
+ * @file   filter.cpp
+ * @author Juraj Grabovac (jgrabovac2@gmail.com)
+ * @date   19/10/2026
+ * @brief  See filter.h
+ ***********************************************************************
+*/
+
+
+/*----- Includes -----*/
+#include "filter.h"
+
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+
+constexpr auto kMaxKeyNum = 256;
+constexpr auto kMaxOperandNum = 256;
+
+/*----- Helper Functions -----*/
+/**
+ * @brief Split string by delimiter, empty parts are skipped.
+ *
+ * @param [in] input - string input
+ * @param [in] delimiter - delimiter character
+ *
+ * @return std::vector<std::string> - parts of input string.
+ */
+std::vector<std::string> split(const std::string& input, char delimiter)
+{
+    std::vector<std::string> parts;
+    size_t start = 0;
+    size_t pos;
+
+    while ((pos = input.find(delimiter, start)) != std::string::npos)
+    {
+        if (pos > start)
+        {
+            parts.push_back(input.substr(start, pos - start));
+        }
+        start = pos + 1;
+    }
+
+    if (start < input.size())
+    {
+        parts.push_back(input.substr(start));
+    }
+
+    return parts;
+}
+
+/**
+ * @brief Convert string to number.
+ *
+ * @param [in] input - string input
+ * @param [out] number - converted number
+ *
+ * @return bool - true if whole string is a number, false otherwise.
+ */
+bool to_number(const std::string& input, double& number)
+{
+    char *end = nullptr;
+
+    if (input.empty())
+    {
+        return false;
+    }
+
+    number = strtod(input.c_str(), &end);
+
+    return (*end == '\0');
+}
+
+}  // namespace
+
+namespace filter_handler {
+
+int FilterHandler::Acquire(const std::string& expression){
+    if(expression.empty()){
+        return kNoFilter;
+    }
+
+    // Identical filters are compiled once and shared between subscribers
+    auto it = _filter_ids.find(expression);
+    if(it != _filter_ids.end()){
+        _filters[it->second].ref_count++;
+        return it->second;
+    }
+
+    compiled_filter filter;
+    if(!Compile(expression, filter)){
+        ReleaseKeys(filter);
+        return kInvalidFilter;
+    }
+
+    int filter_id;
+    if(!_free_filters.empty()){
+        filter_id = _free_filters.back();
+        _free_filters.pop_back();
+        _filters[filter_id] = filter;
+    }
+    else{
+        filter_id = (int)_filters.size();
+        _filters.push_back(filter);
+    }
+
+    _filter_ids[expression] = filter_id;
+
+    return filter_id;
+}
+
+void FilterHandler::Release(int filter_id){
+    if((filter_id < 0) || (filter_id >= (int)_filters.size())){
+        return;
+    }
+
+    compiled_filter& filter = _filters[filter_id];
+    if(--filter.ref_count > 0){
+        return;
+    }
+
+    _filter_ids.erase(filter.expression);
+    ReleaseKeys(filter);
+    filter = compiled_filter();
+    _free_filters.push_back(filter_id);
+}
+
+void FilterHandler::BeginPublish(const std::string& payload){
+    // Generation counter invalidates header map and cached results without clearing them
+    _publish_generation++;
+
+    for(const std::string& field : split(payload, ',')){
+        size_t pos = field.find('=');
+        std::string key = field.substr(0, pos);
+
+        auto it = _key_ids.find(key);
+        if(it == _key_ids.end()){
+            // No filter refers to this key
+            continue;
+        }
+
+        int key_id = it->second;
+        _field_values[key_id] = (pos != std::string::npos) ? field.substr(pos + 1) : "";
+        if(!to_number(_field_values[key_id], _field_numbers[key_id])){
+            _field_numbers[key_id] = NAN;
+        }
+        _field_generation[key_id] = _publish_generation;
+    }
+}
+
+bool FilterHandler::Matches(int filter_id){
+    if((filter_id < 0) || (filter_id >= (int)_filters.size())){
+        return true;
+    }
+
+    compiled_filter& filter = _filters[filter_id];
+    if(filter.result_generation != _publish_generation){
+        filter.result = Execute(filter);
+        filter.result_generation = _publish_generation;
+    }
+
+    return filter.result;
+}
+
+bool FilterHandler::Compile(const std::string& expression, compiled_filter& filter){
+    filter.expression = expression;
+    filter.ref_count = 1;
+    filter.result_generation = 0;
+    filter.result = false;
+
+    for(const std::string& predicate : split(expression, ',')){
+        size_t pos = predicate.find('=');
+
+        // Empty key is rejected before it is interned
+        if(pos == 0){
+            return false;
+        }
+
+        int key_id = InternKey(predicate.substr(0, pos), filter);
+        if(key_id < 0){
+            return false;
+        }
+
+        if(pos == std::string::npos){
+            // key
+            filter.code.push_back(OP_PRESENT);
+            filter.code.push_back((uint8_t)key_id);
+            continue;
+        }
+
+        std::string value = predicate.substr(pos + 1);
+        size_t range_pos = value.find("..");
+
+        if(range_pos == std::string::npos){
+            // key=value
+            if(filter.strings.size() >= kMaxOperandNum){
+                return false;
+            }
+            filter.code.push_back(OP_EQUAL);
+            filter.code.push_back((uint8_t)key_id);
+            filter.code.push_back((uint8_t)filter.strings.size());
+            filter.strings.push_back(value);
+            continue;
+        }
+
+        // key=lo..hi, key=lo.. or key=..hi
+        std::string bounds[2] = {value.substr(0, range_pos), value.substr(range_pos + 2)};
+        filter_opcode opcodes[2] = {OP_MIN, OP_MAX};
+
+        if(bounds[0].empty() && bounds[1].empty()){
+            return false;
+        }
+
+        for(int i = 0; i < 2; ++i){
+            double number;
+
+            if(bounds[i].empty()){
+                continue;
+            }
+            if(!to_number(bounds[i], number) || (filter.numbers.size() >= kMaxOperandNum)){
+                return false;
+            }
+
+            filter.code.push_back(opcodes[i]);
+            filter.code.push_back((uint8_t)key_id);
+            filter.code.push_back((uint8_t)filter.numbers.size());
+            filter.numbers.push_back(number);
+        }
+    }
+
+    filter.code.push_back(OP_END);
+
+    return true;
+}
+
+bool FilterHandler::Execute(const compiled_filter& filter){
+    const uint8_t *pc = filter.code.data();
+
+    while(*pc != OP_END){
+        uint8_t opcode = pc[0];
+        uint8_t key_id = pc[1];
+
+        // Missing field never matches
+        if(_field_generation[key_id] != _publish_generation){
+            return false;
+        }
+
+        switch(opcode)
+        {
+            case OP_PRESENT:
+            {
+                pc += 2;
+
+                break;
+            }
+            case OP_EQUAL:
+            {
+                if(_field_values[key_id] != filter.strings[pc[2]]){
+                    return false;
+                }
+                pc += 3;
+
+                break;
+            }
+            case OP_MIN:
+            {
+                // NaN comparison fails for non-numeric field
+                if(!(_field_numbers[key_id] >= filter.numbers[pc[2]])){
+                    return false;
+                }
+                pc += 3;
+
+                break;
+            }
+            case OP_MAX:
+            {
+                if(!(_field_numbers[key_id] <= filter.numbers[pc[2]])){
+                    return false;
+                }
+                pc += 3;
+
+                break;
+            }
+            default:
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+int FilterHandler::InternKey(const std::string& key, compiled_filter& filter){
+    int key_id;
+
+    auto it = _key_ids.find(key);
+    if(it != _key_ids.end()){
+        key_id = it->second;
+    }
+    else if(!_free_keys.empty()){
+        key_id = _free_keys.back();
+        _free_keys.pop_back();
+        _key_ids[key] = key_id;
+        _key_names[key_id] = key;
+        _field_generation[key_id] = 0;
+    }
+    else if(_key_names.size() < kMaxKeyNum){
+        key_id = (int)_key_names.size();
+        _key_ids[key] = key_id;
+        _key_names.push_back(key);
+        _key_refs.push_back(0);
+        _field_values.push_back("");
+        _field_numbers.push_back(NAN);
+        _field_generation.push_back(0);
+    }
+    else{
+        return -1;
+    }
+
+    _key_refs[key_id]++;
+    filter.keys.push_back(key_id);
+
+    return key_id;
+}
+
+void FilterHandler::ReleaseKeys(compiled_filter& filter){
+    for(int key_id : filter.keys){
+        if(--_key_refs[key_id] > 0){
+            continue;
+        }
+
+        _key_ids.erase(_key_names[key_id]);
+        _key_names[key_id].clear();
+        _free_keys.push_back(key_id);
+    }
+
+    filter.keys.clear();
+}
+
+}  // namespace filter_handler
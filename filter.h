@@ -0,0 +1,144 @@
+/**
+ * @file filter.h
+ *
+ * @brief Implementation of server-side content filters for subscriptions.
+ *
+ * A filter is a comma separated list of predicates over the payload header
+ * map, all of which must match (example: sym=ABC,px=100..200).
+ * Supported predicates are key=value (string equality), key=lo..hi
+ * (inclusive numeric range, either bound may be omitted) and key (field
+ * present). Payload of a PUBLISH message uses the same key=value list.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace filter_handler {
+
+constexpr int kNoFilter = -1;
+constexpr int kInvalidFilter = -2;
+
+class FilterHandler {
+ public:
+  /**
+   * @brief Constructor
+   */
+  FilterHandler() = default;
+
+  /**
+   * @brief Compile filter expression, or share an already compiled one.
+   *
+   * @param [in] expression - filter expression
+   *
+   * @return int - filter id, kNoFilter for empty expression, kInvalidFilter on syntax error.
+   */
+  int Acquire(const std::string& expression);
+
+  /**
+   * @brief Release filter reference, filter is freed with the last reference.
+   *
+   * @param [in] filter_id - filter id returned by Acquire()
+   */
+  void Release(int filter_id);
+
+  /**
+   * @brief Start filter stage for a new published payload.
+   *        Payload header map is parsed once and all cached results are invalidated.
+   *
+   * @param [in] payload - published data
+   */
+  void BeginPublish(const std::string& payload);
+
+  /**
+   * @brief Check if current payload matches filter.
+   *        Each filter is evaluated at most once per publish.
+   *
+   * @param [in] filter_id - filter id returned by Acquire()
+   *
+   * @return bool - true if payload matches filter or there is no filter, false otherwise.
+   */
+  bool Matches(int filter_id);
+
+ private:
+  /*----- Bytecode -----*/
+  enum filter_opcode : uint8_t
+  {
+      OP_PRESENT,   // OP_PRESENT key
+      OP_EQUAL,     // OP_EQUAL key string_idx
+      OP_MIN,       // OP_MIN key number_idx
+      OP_MAX,       // OP_MAX key number_idx
+      OP_END
+  };
+
+  struct compiled_filter
+  {
+      std::string expression;
+      std::vector<uint8_t> code;
+      std::vector<std::string> strings;
+      std::vector<double> numbers;
+      // Interned keys referenced by filter, one reference per predicate
+      std::vector<int> keys;
+      int ref_count;
+      uint32_t result_generation;
+      bool result;
+  };
+
+  /**
+   * @brief Compile filter expression to bytecode.
+   *
+   * @param [in] expression - filter expression
+   * @param [out] filter - compiled filter
+   *
+   * @return bool - true on success, false otherwise.
+   */
+  bool Compile(const std::string& expression, compiled_filter& filter);
+
+  /**
+   * @brief Run filter bytecode against current payload header map.
+   *
+   * @param [in] filter - compiled filter
+   *
+   * @return bool - true if all predicates match, false otherwise.
+   */
+  bool Execute(const compiled_filter& filter);
+
+  /**
+   * @brief Intern header key so that bytecode refers to keys by index, key is referenced by filter.
+   *
+   * @param [in] key - header key
+   * @param [in,out] filter - filter referencing key
+   *
+   * @return int - key index, -1 if key table is full.
+   */
+  int InternKey(const std::string& key, compiled_filter& filter);
+
+  /**
+   * @brief Release keys referenced by filter, key index is reused when the last reference is released.
+   *
+   * @param [in,out] filter - filter referencing keys
+   */
+  void ReleaseKeys(compiled_filter& filter);
+
+  std::vector<compiled_filter> _filters;
+  std::vector<int> _free_filters;
+  std::map<std::string, int> _filter_ids;
+
+  std::map<std::string, int> _key_ids;
+  std::vector<std::string> _key_names;
+  std::vector<int> _key_refs;
+  std::vector<int> _free_keys;
+
+  // Current payload header map indexed by key id, valid if generation matches
+  std::vector<std::string> _field_values;
+  std::vector<double> _field_numbers;
+  std::vector<uint32_t> _field_generation;
+
+  uint32_t _publish_generation = 0;
+};
+
+}  // namespace filter_handler
@@ -0,0 +1,221 @@
+/**
+ ***********************************************************************
+ * @file   frame.cpp
+ * @author Juraj Grabovac (jgrabovac2@gmail.com)
+ * @date   19/10/2026
+ * @brief  See frame.h
+ ***********************************************************************
+*/
+
+
+/*----- Includes -----*/
+#include "frame.h"
+#include "compress.h"
+
+#include <cstring>
+
+namespace {
+
+/*----- Helper Functions -----*/
+/**
+ * @brief Append 32 bit little endian value.
+ *
+ * @param [in] value - value
+ * @param [out] output - output buffer
+ */
+void write_u32(uint32_t value, std::string& output)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        output += (char)((value >> (8 * i)) & 0xFF);
+    }
+}
+
+/**
+ * @brief Read 32 bit little endian value.
+ *
+ * @param [in] data - input buffer
+ *
+ * @return uint32_t - value.
+ */
+uint32_t read_u32(const char *data)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+}  // namespace
+
+namespace frame_handler {
+
+std::string EncodeFrame(frame_codec codec, const std::string& messages){
+    std::string compressed;
+    const std::string *payload = &messages;
+    frame_codec used_codec = CODEC_NONE;
+
+    if((codec == CODEC_LZ4) && (messages.size() >= kCompressMinSize)){
+        compress_handler::Lz4Compress(messages.data(), messages.size(), compressed);
+
+        if(compressed.size() < messages.size()){
+            payload = &compressed;
+            used_codec = CODEC_LZ4;
+        }
+    }
+
+    std::string frame;
+    frame.reserve(kFrameHeaderSize + payload->size());
+
+    write_u32((uint32_t)payload->size(), frame);
+    frame += (char)used_codec;
+    write_u32((uint32_t)messages.size(), frame);
+    frame += *payload;
+
+    return frame;
+}
+
+void FrameReader::SetBinary(bool binary){
+    _binary = binary;
+}
+
+void FrameReader::Append(const char *data, size_t length){
+    memcpy(WriteBuffer(length), data, length);
+    Commit(length);
+}
+
+char *FrameReader::WriteBuffer(size_t length){
+    Compact();
+
+    // Buffer only grows, so that steady reads do not allocate
+    if(_buffer.size() < _end + length){
+        _buffer.resize(_end + length);
+    }
+
+    return &_buffer[_end];
+}
+
+void FrameReader::Commit(size_t length){
+    _end += length;
+}
+
+bool FrameReader::Next(std::string& message){
+    std::string_view view;
+
+    if(!Next(view)){
+        return false;
+    }
+
+    message.assign(view.data(), view.size());
+
+    return true;
+}
+
+bool FrameReader::Next(std::string_view& message){
+    while(1){
+        // Messages of already decoded frame
+        if(_message_offset < _message_end){
+            const char *messages = _messages_in_buffer ? _buffer.data() : _messages.data();
+            const char *start = messages + _message_offset;
+            const char *terminator = (const char *)memchr(start, '\0', _message_end - _message_offset);
+            size_t length = terminator ? (size_t)(terminator - start) : _message_end - _message_offset;
+
+            message = std::string_view(start, length);
+            _message_offset += length + 1;
+
+            if(message.empty()){
+                continue;
+            }
+
+            return true;
+        }
+
+        if(_binary){
+            if(!DecodeFrame()){
+                return false;
+            }
+
+            continue;
+        }
+
+        const char *start = _buffer.data() + _offset;
+        const char *terminator = (const char *)memchr(start, '\0', _end - _offset);
+        if(terminator == nullptr){
+            return false;
+        }
+
+        message = std::string_view(start, terminator - start);
+        _offset += message.size() + 1;
+
+        // Skip padding between messages
+        if(!message.empty()){
+            return true;
+        }
+    }
+}
+
+bool FrameReader::DecodeFrame(){
+    if(_corrupted || (_end - _offset < kFrameHeaderSize)){
+        return false;
+    }
+
+    const char *header = _buffer.data() + _offset;
+    uint32_t payload_length = read_u32(header);
+    frame_codec codec = (frame_codec)header[4];
+    uint32_t raw_length = read_u32(header + 5);
+
+    if((payload_length > kMaxFrameSize) || (raw_length > kMaxFrameSize)){
+        _corrupted = true;
+        return false;
+    }
+
+    if(_end - _offset < kFrameHeaderSize + payload_length){
+        return false;
+    }
+
+    const char *payload = header + kFrameHeaderSize;
+
+    if(codec == CODEC_LZ4){
+        if(!compress_handler::Lz4Decompress(payload, payload_length, raw_length, _messages)){
+            _corrupted = true;
+            return false;
+        }
+
+        _messages_in_buffer = false;
+        _message_offset = 0;
+        _message_end = _messages.size();
+    }
+    else{
+        // Uncompressed messages are read where they were received
+        _messages_in_buffer = true;
+        _message_offset = _offset + kFrameHeaderSize;
+        _message_end = _message_offset + payload_length;
+    }
+
+    _offset += kFrameHeaderSize + payload_length;
+
+    return true;
+}
+
+void FrameReader::Compact(){
+    size_t start = _offset;
+
+    // Unread messages of uncompressed frame are kept too
+    if(_messages_in_buffer && (_message_offset < _message_end) && (_message_offset < start)){
+        start = _message_offset;
+    }
+
+    if(start == 0){
+        return;
+    }
+
+    memmove(&_buffer[0], _buffer.data() + start, _end - start);
+    _end -= start;
+    _offset -= start;
+
+    if(_messages_in_buffer){
+        _message_offset = (_message_offset > start) ? _message_offset - start : 0;
+        _message_end = (_message_end > start) ? _message_end - start : 0;
+    }
+}
+
+}  // namespace frame_handler
@@ -0,0 +1,160 @@
+/**
+ * @file frame.h
+ *
+ * @brief Implementation of message framing.
+ *
+ * Text messages are terminated by null character. After compression is
+ * negotiated, server sends binary frames instead, each frame carries one
+ * or more null terminated messages:
+ *
+ *   uint32 payload length | uint8 codec | uint32 raw length | payload
+ *
+ * All integers are little endian. Raw length is the length of payload
+ * after decompression.
+ *
+ * Reader keeps one growing buffer that is reused for all reads. Receiver
+ * can read into it directly and take messages as views into the buffer,
+ * so messages of uncompressed input are never copied.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace frame_handler {
+
+constexpr size_t kFrameHeaderSize = 9;
+constexpr size_t kMaxFrameSize = 16 * 1024 * 1024;
+
+// Smaller payloads are not worth compressing and are batched instead
+constexpr size_t kCompressMinSize = 256;
+
+enum frame_codec : uint8_t
+{
+    CODEC_NONE,
+    CODEC_LZ4
+};
+
+/**
+ * @brief Encode messages to binary frame.
+ *        Payload is compressed only if codec is set, payload is large enough and compression reduces it.
+ *
+ * @param [in] codec - negotiated codec
+ * @param [in] messages - null terminated messages
+ *
+ * @return std::string - binary frame.
+ */
+std::string EncodeFrame(frame_codec codec, const std::string& messages);
+
+class FrameReader {
+ public:
+  /**
+   * @brief Constructor
+   */
+  FrameReader() = default;
+
+  /**
+   * @brief Switch between text messages and binary frames.
+   *        Bytes already appended but not read are parsed in the new mode.
+   *
+   * @param [in] binary - true for binary frames, false for text messages
+   */
+  void SetBinary(bool binary);
+
+  /**
+   * @brief Append received bytes.
+   *
+   * @param [in] data - received bytes
+   * @param [in] length - number of received bytes
+   */
+  void Append(const char *data, size_t length);
+
+  /**
+   * @brief Get space for receiving bytes directly into reader buffer.
+   *        Buffer is allocated once and reused, unread bytes are moved to its start.
+   *
+   * @param [in] length - number of bytes to receive
+   *
+   * @return char* - pointer to at least length writable bytes, valid until the next call of Commit() or Append().
+   */
+  char *WriteBuffer(size_t length);
+
+  /**
+   * @brief Mark bytes received to WriteBuffer() as appended.
+   *
+   * @param [in] length - number of received bytes
+   */
+  void Commit(size_t length);
+
+  /**
+   * @brief Get next complete message.
+   *
+   * @param [out] message - message without terminating null character
+   *
+   * @return bool - true if message is available, false if more bytes are needed.
+   */
+  bool Next(std::string& message);
+
+  /**
+   * @brief Get next complete message without copying it.
+   *
+   * @param [out] message - view of message without terminating null character, valid until bytes are appended
+   *
+   * @return bool - true if message is available, false if more bytes are needed.
+   */
+  bool Next(std::string_view& message);
+
+  /**
+   * @brief Check if stream contained invalid frame.
+   *
+   * @return bool - true if stream is corrupted, false otherwise.
+   */
+  bool Corrupted() const { return _corrupted; }
+
+  /**
+   * @brief Get bytes appended but not read yet, so that partial input can be handed over.
+   *
+   * @return std::string - unread bytes.
+   */
+  std::string Pending() const { return _buffer.substr(_offset, _end - _offset); }
+
+  /**
+   * @brief Get number of bytes appended but not read yet, incomplete message included.
+   *
+   * @return size_t - number of unread bytes.
+   */
+  size_t PendingSize() const { return _end - _offset; }
+
+ private:
+  /**
+   * @brief Decode next binary frame from buffer. Messages of uncompressed frame are read in place,
+   *        compressed frame is decompressed to decoded messages.
+   *
+   * @return bool - true if frame is decoded, false if frame is incomplete or corrupted.
+   */
+  bool DecodeFrame();
+
+  /**
+   * @brief Move unread bytes to the start of buffer.
+   */
+  void Compact();
+
+  // Bytes from _offset to _end are received but not read, buffer beyond _end is free space
+  std::string _buffer;
+  size_t _offset = 0;
+  size_t _end = 0;
+
+  // Messages of current frame, either in decoded messages or in place in buffer
+  std::string _messages;
+  bool _messages_in_buffer = false;
+  size_t _message_offset = 0;
+  size_t _message_end = 0;
+
+  bool _binary = false;
+  bool _corrupted = false;
+};
+
+}  // namespace frame_handler
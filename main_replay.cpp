@@ -0,0 +1,274 @@
+/**
+ * @file main_replay.cpp
+ *
+ * @brief Replay tool entry point.
+ *
+ * Replay starts a server and feeds it a trace recorded with --capture.
+ * Every captured connection is opened again over loopback and its commands
+ * are sent at their original time, divided by speed factor. Messages the
+ * server delivers to replayed connections are read and discarded.
+ *
+ */
+
+#include "capture.h"
+#include "server.h"
+
+#include <cstdlib>
+#include <map>
+
+namespace {
+
+constexpr auto kDefaultReplayPort = 54100;
+
+server_handler::ServerHandler ser_handler;
+std::map<uint32_t, SOCKET> _connections;
+uint64_t _bytes_received = 0;
+
+/**
+ * @brief Open replayed connection to server.
+ *
+ * @param [in] port_num - server port
+ *
+ * @return SOCKET - connected socket, INVALID_SOCKET on failure.
+ */
+SOCKET open_connection(int port_num)
+{
+    sockaddr_in hint;
+    hint.sin_family = AF_INET;
+    hint.sin_port = htons(port_num);
+    hint.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == INVALID_SOCKET)
+    {
+        return INVALID_SOCKET;
+    }
+
+    if (connect(sock, (sockaddr*)&hint, sizeof(hint)) == SOCKET_ERROR)
+    {
+        closesocket(sock);
+        return INVALID_SOCKET;
+    }
+
+    return sock;
+}
+
+/**
+ * @brief Read and discard deliveries on all replayed connections until timeout expires.
+ *
+ * @param [in] timeout_us - microseconds to wait, 0 only reads what is already received
+ */
+void drain_connections(int64_t timeout_us)
+{
+    char bufInput[16 * 1024];
+
+    do
+    {
+        fd_set read_flags;
+        FD_ZERO(&read_flags);
+
+        for (const auto& connection : _connections)
+        {
+            FD_SET(connection.second, &read_flags);
+        }
+
+        if (read_flags.fd_count == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(timeout_us));
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        timeval timeout;
+        timeout.tv_sec = (long)(timeout_us / 1000000);
+        timeout.tv_usec = (long)(timeout_us % 1000000);
+
+        if (select(0, &read_flags, nullptr, nullptr, &timeout) <= 0)
+        {
+            return;
+        }
+
+        for (auto it = _connections.begin(); it != _connections.end();)
+        {
+            if (!FD_ISSET(it->second, &read_flags))
+            {
+                ++it;
+                continue;
+            }
+
+            int bytesIn = recv(it->second, bufInput, sizeof(bufInput), 0);
+            if (bytesIn <= 0)
+            {
+                // Server closed connection, for example after DISCONNECT
+                closesocket(it->second);
+                it = _connections.erase(it);
+                continue;
+            }
+
+            _bytes_received += bytesIn;
+            ++it;
+        }
+
+        timeout_us -= std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    } while (timeout_us > 0);
+}
+
+/**
+ * @brief Send command with terminating null character on replayed connection.
+ *
+ * @param [in] sock - socket
+ * @param [in] message - command
+ *
+ * @return bool - true on success, false on connection error.
+ */
+bool send_command(SOCKET sock, const std::string& message)
+{
+    const char *data = message.c_str();
+    int length = message.size() + 1;
+
+    while (length > 0)
+    {
+        int bytesOut = send(sock, data, length, 0);
+        if (bytesOut == SOCKET_ERROR)
+        {
+            return false;
+        }
+
+        data += bytesOut;
+        length -= bytesOut;
+    }
+
+    return true;
+}
+
+} // namespace
+
+using namespace std;
+
+int main(int argc, char **argv){
+    int port_num = kDefaultReplayPort;
+    int speed = 1;
+    server_handler::ServerConfig config;
+    capture_handler::CaptureReader reader;
+
+    // Trace is the first argument, options: --port <server port>, --speed <factor, 0 for as fast as possible>,
+    //                                       --routers <number of router threads>
+    if ((argc < 2) || !reader.Open(argv[1]))
+    {
+        cout << "Usage: replay.exe <trace> [--port N] [--speed N] [--routers N]" << endl;
+        return 1;
+    }
+
+    for (int i = 2; i < argc; ++i)
+    {
+        if ((strcmp(argv[i], "--port") == 0) && (i + 1 < argc))
+        {
+            port_num = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--speed") == 0) && (i + 1 < argc))
+        {
+            speed = atoi(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--routers") == 0) && (i + 1 < argc))
+        {
+            config.router_num = atoi(argv[++i]);
+        }
+        else
+        {
+            cout << "Unknown argument: " << argv[i] << endl;
+        }
+    }
+
+    // Replayed clients reconnect under recorded names, their sessions must not outlive the replay
+    config.session_expiry = 0;
+
+    // Server is listening when Init returns, it fails if the port is taken by another process
+    if (!ser_handler.Init(port_num, config))
+    {
+        cout << "Unable to initialize server handler" << endl;
+        return 1;
+    }
+
+    capture_handler::capture_record record;
+    uint64_t record_num = 0, message_num = 0;
+    auto start = chrono::steady_clock::now();
+
+    while (reader.Next(record))
+    {
+        record_num++;
+
+        // Wait for original time of record, reading deliveries meanwhile
+        if (speed > 0)
+        {
+            auto due = start + chrono::microseconds(record.timestamp_us / speed);
+            int64_t wait_us = chrono::duration_cast<chrono::microseconds>(due - chrono::steady_clock::now()).count();
+
+            if (wait_us > 0)
+            {
+                drain_connections(wait_us);
+            }
+        }
+
+        drain_connections(0);
+
+        auto connection = _connections.find(record.connection_id);
+
+        if (record.type == capture_handler::CAPTURE_DISCONNECT)
+        {
+            if (connection != _connections.end())
+            {
+                closesocket(connection->second);
+                _connections.erase(connection);
+            }
+
+            continue;
+        }
+
+        // Capture may start while connection is already open, it is opened on its first command
+        if (connection == _connections.end())
+        {
+            SOCKET sock = open_connection(port_num);
+            if (sock == INVALID_SOCKET)
+            {
+                cerr << "Can't connect to server, Err #" << WSAGetLastError() << endl;
+                break;
+            }
+
+            connection = _connections.emplace(record.connection_id, sock).first;
+        }
+
+        if (record.type == capture_handler::CAPTURE_MESSAGE)
+        {
+            if (!send_command(connection->second, record.message))
+            {
+                closesocket(connection->second);
+                _connections.erase(connection);
+                continue;
+            }
+
+            message_num++;
+        }
+    }
+
+    auto elapsed_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+    // Let server deliver the last messages
+    drain_connections(1000000);
+
+    for (const auto& connection : _connections)
+    {
+        closesocket(connection.second);
+    }
+
+    cout << "Records: " << record_num << ", commands: " << message_num << ", received bytes: " << _bytes_received << endl;
+    cout << "Replay time: " << elapsed_us / 1000 << " ms";
+    if (elapsed_us > 0)
+    {
+        cout << ", " << (message_num * 1000000 / elapsed_us) << " commands/s";
+    }
+    cout << endl;
+
+    ser_handler.Shutdown();
+
+    return 0;
+}
@@ -10,57 +10,142 @@
 namespace {
 
 server_handler::ServerHandler ser_handler;
+std::atomic<bool> _stop_requested(false);
 
-} // namespace
+/**
+ * @brief Console control handler, Ctrl+C and closing console window stop the server.
+ * 
+ * @param [in] ctrl_type - control event
+ *
+ * @return BOOL - TRUE if event is handled.
+ */
+BOOL WINAPI console_handler(DWORD ctrl_type)
+{
+    (void)ctrl_type;
+    _stop_requested = true;
 
-using namespace std;
+    return TRUE;
+}
 
-int main(int argc, char **argv){
+/**
+ * @brief Convert input argument to number.
+ * 
+ * @param [in] arg - input argument
+ *
+ * @return int - number.
+ */
+int convert_argument(const char *arg)
+{
     int i = 0, j = 0, arg_size = 0;
-    int port_num = 0, temp_port_num = 0;
+    int number = 0, temp_number = 0;
     
-    // Check input arguments
-    if (argc != 2)
+    while(arg[i] != '\0')
     {
-        // Default port
-        port_num = 54000;
+        ++i;
     }
-    else
+
+    arg_size = i; 
+
+    while(i > 0)
     {
-        // Calculate port - convert input argument to port
-        while(argv[1][i] != '\0')
+        j = i;
+    
+        --i;
+        temp_number = arg[i] - '0';
+    
+        while(j < arg_size)
         {
-            ++i;
+            temp_number *= 10;
+            ++j;
         }
     
-        arg_size = i; 
+        number += temp_number;
+    } 
+    
+    return number;
+}
+
+} // namespace
+
+using namespace std;
+
+int main(int argc, char **argv){
+    int i = 1;
+    int port_num = 54000;
+    server_handler::ServerConfig config;
+    
+    // Check input arguments, port is the first argument (default port is used if it is not sent)
+    if ((argc > 1) && (strncmp(argv[1], "--", 2) != 0))
+    {
+        port_num = convert_argument(argv[1]);
+        ++i;
+    }
     
-        while(i > 0)
+    // Options: --routers <number of router threads>, --peer <[host:]port of server to bridge to>,
+    //          --session-expiry <seconds session of disconnected client is kept>,
+    //          --low-latency, --busy-poll <microseconds of polling before blocking>, --io-cpu <CPU of server thread>,
+    //          --drain-ms <milliseconds pending output is sent on shutdown>, --hot-restart,
+    //          --capture <file inbound commands are recorded to>
+    for (; i < argc; ++i)
+    {
+        if ((strcmp(argv[i], "--routers") == 0) && (i + 1 < argc))
         {
-            j = i;
-        
-            --i;
-            temp_port_num = argv[1][i] - '0';
-        
-            while(j < arg_size)
-            {
-                temp_port_num *= 10;
-                ++j;
-            }
-        
-            port_num += temp_port_num;
-        } 
-    } 
+            config.router_num = convert_argument(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--peer") == 0) && (i + 1 < argc))
+        {
+            config.peers.push_back(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--session-expiry") == 0) && (i + 1 < argc))
+        {
+            config.session_expiry = convert_argument(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--low-latency") == 0)
+        {
+            config.low_latency = true;
+        }
+        else if ((strcmp(argv[i], "--busy-poll") == 0) && (i + 1 < argc))
+        {
+            config.low_latency = true;
+            config.busy_poll_us = convert_argument(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--io-cpu") == 0) && (i + 1 < argc))
+        {
+            config.io_cpu = convert_argument(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "--drain-ms") == 0) && (i + 1 < argc))
+        {
+            config.drain_ms = convert_argument(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--hot-restart") == 0)
+        {
+            config.hot_restart = true;
+        }
+        else if ((strcmp(argv[i], "--capture") == 0) && (i + 1 < argc))
+        {
+            config.capture_path = argv[++i];
+        }
+        else
+        {
+            cout << "Unknown argument: " << argv[i] << endl;
+        }
+    }
     
     cout << "Port: " << port_num << endl;
 
-    if(!ser_handler.Init(port_num)){
+    SetConsoleCtrlHandler(console_handler, TRUE);
+
+    if(!ser_handler.Init(port_num, config)){
         cout << "Unable to initialize server handler" << endl;
+        return 1;
     }
 
-    while(1){
-        this_thread::sleep_for(chrono::seconds(1));
+    // Server stops on Ctrl+C, or by itself after new process took it over
+    while(!_stop_requested && ser_handler.IsRunning()){
+        this_thread::sleep_for(chrono::milliseconds(100));
     }
 
+    ser_handler.Shutdown();
+
     return 0;
 }
\ No newline at end of file
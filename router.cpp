@@ -0,0 +1,538 @@
+/**
+ ***********************************************************************
+ * @file   router.cpp
+ * @author Juraj Grabovac (jgrabovac2@gmail.com)
+ * @date   19/10/2026
+ * @brief  See router.h
+ ***********************************************************************
+*/
+
+
+/*----- Includes -----*/
+#include "router.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+constexpr auto kQueueSize = 4096;
+constexpr auto kIdleSpinNum = 1000;
+constexpr auto kBusySpinNum = 200000;
+constexpr auto kVirtualNodeNum = 64;
+
+/*----- Helper Functions -----*/
+/**
+ * @brief Mix 64 bit value so that consecutive ids are spread over hash ring.
+ *
+ * @param [in] value - input value
+ *
+ * @return uint64_t - hash.
+ */
+uint64_t mix_hash(uint64_t value)
+{
+    value += 0x9E3779B97F4A7C15ULL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+
+    return value ^ (value >> 31);
+}
+
+/**
+ * @brief Function hashes string with 64 bit FNV-1a, hash must be the same in every process.
+ *
+ * @param [in] value - string value
+ *
+ * @return uint64_t - hash.
+ */
+uint64_t fnv_hash(const std::string &value)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    for(unsigned char c : value)
+    {
+        hash ^= c;
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+}  // namespace
+
+using namespace std;
+
+namespace router_handler {
+
+RouterHandler::RouterHandler()
+    : _commands(kQueueSize),
+      _events(kQueueSize),
+      _running(false),
+      _sleeping(false),
+      _wake_sock(INVALID_SOCKET),
+      _wake_pending(false),
+      _port_num(0) {
+}
+
+RouterHandler::~RouterHandler() {
+    _running = false;
+    _sleep_cond.notify_one();
+
+    if(_router_thread.joinable()){
+        _router_thread.join();
+    }
+}
+
+bool RouterHandler::Init(int port_num, SOCKET wake_sock, const sockaddr_in& wake_addr, const RouterConfig& config){
+    _port_num = port_num;
+    _wake_sock = wake_sock;
+    _wake_addr = wake_addr;
+    _config = config;
+
+    _running = true;
+    _router_thread = std::thread(&RouterHandler::RouterThread, this);
+
+    return true;
+}
+
+void RouterHandler::PushCommand(router_command&& command){
+    // Full queue means router is behind, wait for it instead of dropping commands
+    while(!_commands.Push(std::move(command))){
+        std::this_thread::yield();
+    }
+
+    if(_sleeping.load()){
+        std::lock_guard<std::mutex> lock(_sleep_mutex);
+        _sleep_cond.notify_one();
+    }
+}
+
+bool RouterHandler::PopEvent(router_event& event){
+    return _events.Pop(event);
+}
+
+bool RouterHandler::HasEvents() const{
+    return !_events.Empty();
+}
+
+bool RouterHandler::Idle() const{
+    return _commands.Empty() && _events.Empty() && (_overflow_num.load() == 0);
+}
+
+void RouterHandler::ClearWake(){
+    _wake_pending = false;
+}
+
+void RouterHandler::RouterThread(){
+    router_command command;
+    int idle_count = 0;
+    int spin_num = _config.busy_poll ? kBusySpinNum : kIdleSpinNum;
+
+    // Router runs off the CPU reserved for server thread
+    if(_config.cpu_mask != 0){
+        SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)_config.cpu_mask);
+    }
+
+    while(_running){
+        if(!_overflow_events.empty()){
+            FlushOverflowEvents();
+        }
+
+        if(_commands.Pop(command)){
+            HandleCommand(command);
+            idle_count = 0;
+            continue;
+        }
+
+        // Spin briefly before sleeping, commands usually come in bursts
+        if(++idle_count < spin_num){
+            if(_config.busy_poll){
+                YieldProcessor();
+            }
+            else{
+                std::this_thread::yield();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleep_mutex);
+        _sleeping = true;
+        if(_commands.Empty() && _running){
+            _sleep_cond.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        _sleeping = false;
+    }
+}
+
+void RouterHandler::HandleCommand(router_command& command){
+    switch(command.type)
+    {
+        case ROUTE_PUBLISH:
+        {
+            Publish(command);
+
+            break;
+        }
+        case ROUTE_SUBSCRIBE:
+        {
+            Subscribe(command);
+
+            break;
+        }
+        case ROUTE_UNSUBSCRIBE:
+        {
+            Unsubscribe(command);
+
+            break;
+        }
+        case ROUTE_REMOVE_CLIENT:
+        {
+            RemoveClient(command.client_id);
+
+            break;
+        }
+        case ROUTE_SUSPEND_CLIENT:
+        {
+            SuspendClient(command.client_id);
+
+            break;
+        }
+        case ROUTE_RESUME_CLIENT:
+        {
+            ResumeClient(command);
+
+            break;
+        }
+    }
+}
+
+void RouterHandler::Publish(router_command& command){
+    auto it = _topics.find(command.topic);
+    if(it == _topics.end()){
+        return;
+    }
+
+    // Message expired while waiting in router queue, it is not written to rings either
+    if((command.expiry_us != 0) &&
+       (command.expiry_us <= (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::steady_clock::now().time_since_epoch()).count())){
+        return;
+    }
+
+    topic_entry& entry = it->second;
+
+    // Filter stage: payload header is parsed once and each filter is evaluated
+    // at most once per publish, no matter how many subscribers share it
+    _filter_handler.BeginPublish(command.data);
+
+    ostringstream ss;
+    ss << "[Message] Topic: " << entry.topic << " Data: " << command.data << endl;
+
+    router_event event;
+    event.type = ROUTE_DELIVER;
+    event.topic = entry.topic;
+    event.message = ss.str();
+    event.data = command.data;
+    event.priority = command.priority;
+    event.expiry_us = command.expiry_us;
+
+    // Message is written once to topic ring for all shared memory subscribers,
+    // message longer than ring slot is sent to them over TCP instead
+    bool shm_written = true;
+    if(entry.ring){
+        shm_written = entry.ring->Write(event.message.c_str(), event.message.size());
+    }
+
+    for(const subscriber& sub : entry.subscribers){
+        // Message received from a bridge is not sent back to bridges, servers are fully meshed
+        if(sub.bridge_flag && command.bridge_flag){
+            continue;
+        }
+
+        if((!sub.shm_flag || !shm_written) && _filter_handler.Matches(sub.filter_id)){
+            event.targets.push_back({sub.client_id, sub.conflate_flag, sub.qos_flag});
+        }
+    }
+
+    if(!event.targets.empty()){
+        PushEvent(std::move(event));
+    }
+}
+
+void RouterHandler::Subscribe(router_command& command){
+    // Compile filter, identical filters are shared between subscribers
+    int filter_id = _filter_handler.Acquire(command.filter);
+    if(filter_id == filter_handler::kInvalidFilter){
+        cout << "Invalid filter" << endl;
+        return;
+    }
+
+    topic_entry& entry = _topics[command.topic];
+    entry.topic = command.topic;
+
+    int count_before = LocalSubscriberCount(entry);
+
+    auto it = std::find_if(entry.subscribers.begin(), entry.subscribers.end(),
+                           [&](const subscriber& sub) { return sub.client_id == command.client_id; });
+    if(it == entry.subscribers.end()){
+        entry.subscribers.push_back({command.client_id, filter_handler::kNoFilter, 0, 0, 0, command.bridge_flag, 0});
+        it = entry.subscribers.end() - 1;
+    }
+
+    UpdateInterest(entry.topic, count_before, LocalSubscriberCount(entry));
+
+    subscriber& sub = *it;
+    _filter_handler.Release(sub.filter_id);
+    sub.filter_id = filter_id;
+    sub.conflate_flag = command.conflate_flag;
+    sub.qos_flag = command.qos_flag;
+
+    // Shared memory is used for local clients that subscribed without filter, conflation and
+    // acknowledgements, because all consumers of a topic ring read the same messages
+    int shm_wanted = command.shm_flag && (filter_id == filter_handler::kNoFilter) &&
+                     (command.conflate_flag == 0) && (command.qos_flag == 0);
+
+    if(sub.shm_flag && !shm_wanted){
+        DetachShm(entry, sub);
+
+        router_event event;
+        event.type = ROUTE_CONTROL;
+        event.message = "[Transport] TCP " + entry.topic + "\n";
+        event.targets.push_back({sub.client_id, 0, 0});
+        PushEvent(std::move(event));
+        cout << "Client moved to TCP transport" << endl;
+    }
+    else if(!sub.shm_flag && shm_wanted){
+        string segment = shm_transport::ShmRing::SegmentName(_port_num, entry.topic);
+
+        if(!entry.ring){
+            entry.ring.reset(new shm_transport::ShmRing());
+            if(!entry.ring->Create(segment)){
+                entry.ring.reset();
+                cout << "Can't create shared memory ring" << endl;
+            }
+        }
+
+        if(entry.ring){
+            sub.shm_flag = 1;
+
+            router_event event;
+            event.type = ROUTE_CONTROL;
+            // Client starts reading at the current sequence, messages published before it attaches are not lost
+            event.message = "[Transport] SHM " + entry.topic + " " + segment + " " +
+                            to_string(entry.ring->WriteSeq()) + "\n";
+            event.targets.push_back({sub.client_id, 0, 0});
+            PushEvent(std::move(event));
+            cout << "Client moved to shared memory transport" << endl;
+        }
+    }
+
+    cout << "Topic Subscribed" << endl;
+}
+
+void RouterHandler::Unsubscribe(router_command& command){
+    auto it = _topics.find(command.topic);
+    if(it == _topics.end()){
+        return;
+    }
+
+    topic_entry& entry = it->second;
+    int count_before = LocalSubscriberCount(entry);
+
+    for(auto sub = entry.subscribers.begin(); sub != entry.subscribers.end(); ++sub){
+        if(sub->client_id != command.client_id){
+            continue;
+        }
+
+        if(sub->shm_flag){
+            DetachShm(entry, *sub);
+
+            router_event event;
+            event.type = ROUTE_CONTROL;
+            event.message = "[Transport] TCP " + entry.topic + "\n";
+            event.targets.push_back({sub->client_id, 0, 0});
+            PushEvent(std::move(event));
+        }
+
+        _filter_handler.Release(sub->filter_id);
+        entry.subscribers.erase(sub);
+        cout << "Topic Unsubscribed" << endl;
+
+        break;
+    }
+
+    UpdateInterest(entry.topic, count_before, LocalSubscriberCount(entry));
+
+    if(entry.subscribers.empty()){
+        _topics.erase(it);
+    }
+}
+
+void RouterHandler::RemoveClient(uint32_t client_id){
+    for(auto it = _topics.begin(); it != _topics.end();){
+        topic_entry& entry = it->second;
+        int count_before = LocalSubscriberCount(entry);
+
+        for(auto sub = entry.subscribers.begin(); sub != entry.subscribers.end();){
+            if(sub->client_id == client_id){
+                DetachShm(entry, *sub);
+                _filter_handler.Release(sub->filter_id);
+                sub = entry.subscribers.erase(sub);
+            }
+            else{
+                ++sub;
+            }
+        }
+
+        UpdateInterest(entry.topic, count_before, LocalSubscriberCount(entry));
+
+        if(entry.subscribers.empty()){
+            it = _topics.erase(it);
+        }
+        else{
+            ++it;
+        }
+    }
+}
+
+void RouterHandler::SuspendClient(uint32_t client_id){
+    for(auto& it : _topics){
+        topic_entry& entry = it.second;
+
+        for(subscriber& sub : entry.subscribers){
+            if((sub.client_id == client_id) && sub.shm_flag){
+                sub.resume_seq = entry.ring->WriteSeq();
+            }
+        }
+    }
+}
+
+void RouterHandler::ResumeClient(router_command& command){
+    for(auto& it : _topics){
+        topic_entry& entry = it.second;
+
+        for(subscriber& sub : entry.subscribers){
+            if((sub.client_id != command.client_id) || !sub.shm_flag){
+                continue;
+            }
+
+            router_event event;
+            event.type = ROUTE_CONTROL;
+            event.targets.push_back({sub.client_id, 0, 0});
+
+            if(command.shm_flag){
+                // Messages published while client was disconnected are still in the ring, unless it wrapped around
+                event.message = "[Transport] SHM " + entry.topic + " " +
+                                shm_transport::ShmRing::SegmentName(_port_num, entry.topic) + " " +
+                                to_string(sub.resume_seq) + "\n";
+            }
+            else{
+                // Client reconnected from another host, topic continues over TCP
+                DetachShm(entry, sub);
+                event.message = "[Transport] TCP " + entry.topic + "\n";
+            }
+
+            PushEvent(std::move(event));
+        }
+    }
+}
+
+void RouterHandler::DetachShm(topic_entry& entry, subscriber& sub){
+    if(!sub.shm_flag){
+        return;
+    }
+
+    sub.shm_flag = 0;
+
+    for(const subscriber& other : entry.subscribers){
+        if(other.shm_flag){
+            return;
+        }
+    }
+
+    entry.ring.reset();
+}
+
+int RouterHandler::LocalSubscriberCount(const topic_entry& entry) const{
+    int count = 0;
+
+    for(const subscriber& sub : entry.subscribers){
+        if(!sub.bridge_flag){
+            count++;
+        }
+    }
+
+    return count;
+}
+
+void RouterHandler::UpdateInterest(const std::string& topic, int count_before, int count_after){
+    if((count_before == 0) == (count_after == 0)){
+        return;
+    }
+
+    router_event event;
+    event.type = ROUTE_INTEREST;
+    event.topic = topic;
+    event.interest_flag = (count_after > 0) ? 1 : 0;
+    PushEvent(std::move(event));
+}
+
+void RouterHandler::PushEvent(router_event&& event){
+    // Server thread may itself wait for room in command queue of this router, so waiting
+    // for room in event queue could deadlock both threads. Event is kept aside instead,
+    // behind earlier kept events to preserve the order.
+    if(!_overflow_events.empty() || !_events.Push(std::move(event))){
+        _overflow_events.push_back(std::move(event));
+        _overflow_num = _overflow_events.size();
+    }
+
+    WakeServer();
+}
+
+void RouterHandler::FlushOverflowEvents(){
+    while(!_overflow_events.empty() && _events.Push(std::move(_overflow_events.front()))){
+        _overflow_events.pop_front();
+    }
+
+    _overflow_num = _overflow_events.size();
+
+    WakeServer();
+}
+
+void RouterHandler::WakeServer(){
+    // Only the first event after server thread rearmed the wake-up sends a datagram
+    if(!_wake_pending.exchange(true)){
+        char wake = 0;
+        sendto(_wake_sock, &wake, 1, 0, (sockaddr*)&_wake_addr, sizeof(_wake_addr));
+    }
+}
+
+void ConsistentHash::Init(int router_num){
+    _ring.clear();
+
+    // Several points per router keep topics evenly spread
+    for(int router = 0; router < router_num; ++router){
+        for(int node = 0; node < kVirtualNodeNum; ++node){
+            _ring.push_back({mix_hash(((uint64_t)(router + 1) << 32) | (uint64_t)node), router});
+        }
+    }
+
+    std::sort(_ring.begin(), _ring.end());
+}
+
+int ConsistentHash::RouterFor(const std::string& topic) const{
+    if(_ring.empty()){
+        return 0;
+    }
+
+    auto it = std::lower_bound(_ring.begin(), _ring.end(), std::make_pair(mix_hash(fnv_hash(topic)), 0));
+    if(it == _ring.end()){
+        it = _ring.begin();
+    }
+
+    return it->second;
+}
+
+}  // namespace router_handler
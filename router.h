@@ -0,0 +1,340 @@
+/**
+ * @file router.h
+ *
+ * @brief Implementation of topic router threads.
+ *
+ * Topics are partitioned between router threads by consistent hashing of
+ * topic names. Every router thread owns the subscriber registry of
+ * its topics, so registry is accessed without locks. Server thread sends
+ * commands to router through SPSC queue and router sends deliveries back
+ * through another SPSC queue, so messages of one topic keep their order.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <WS2tcpip.h>
+
+#include "filter.h"
+#include "shm.h"
+#include "spsc_queue.h"
+
+namespace router_handler {
+
+/*----- Enums and Structures -----*/
+enum router_command_type
+{
+    ROUTE_PUBLISH,
+    ROUTE_SUBSCRIBE,
+    ROUTE_UNSUBSCRIBE,
+    ROUTE_REMOVE_CLIENT,
+    ROUTE_SUSPEND_CLIENT,
+    ROUTE_RESUME_CLIENT
+};
+
+// Priority of outbound message, subscriber lanes are flushed in this order
+enum message_priority
+{
+    PRIORITY_CONTROL,
+    PRIORITY_HIGH,
+    PRIORITY_NORMAL,
+    PRIORITY_BULK,
+    PRIORITY_NUM
+};
+
+enum router_event_type
+{
+    ROUTE_DELIVER,
+    ROUTE_CONTROL,
+    ROUTE_INTEREST
+};
+
+struct router_command
+{
+    router_command_type type;
+    uint32_t client_id;
+    std::string topic;
+    std::string data;
+    std::string filter;
+    int conflate_flag;
+    int shm_flag;
+    // Subscription with at-least-once delivery
+    int qos_flag;
+    // Subscriber is a bridge to another server, or message was published by a bridge
+    int bridge_flag;
+    // Published message priority and expiry time in steady clock microseconds, 0 if it never expires
+    message_priority priority;
+    uint64_t expiry_us;
+};
+
+struct router_target
+{
+    uint32_t client_id;
+    int conflate_flag;
+    int qos_flag;
+};
+
+struct router_event
+{
+    router_event_type type;
+    std::string topic;
+    // Formatted message for ROUTE_DELIVER, control message for ROUTE_CONTROL
+    std::string message;
+    // Published data, forwarded as is to bridges
+    std::string data;
+    std::vector<router_target> targets;
+    // ROUTE_INTEREST: 1 when topic got its first local subscriber, 0 when it lost the last one
+    int interest_flag;
+    message_priority priority;
+    uint64_t expiry_us;
+};
+
+struct RouterConfig
+{
+    // CPUs router thread may run on, 0 keeps default affinity
+    uint64_t cpu_mask = 0;
+    // Spin on empty queue without yielding before sleep
+    bool busy_poll = false;
+};
+
+class RouterHandler {
+ public:
+  /**
+   * @brief Constructor
+   */
+  RouterHandler();
+
+  /**
+   * @brief Destructor
+   */
+  ~RouterHandler();
+
+  /**
+   * @brief Initializes Router handler and starts router thread.
+   *
+   * @param [in] port_num - server port number, used for shared memory segment names
+   * @param [in] wake_sock - UDP socket used to wake server thread
+   * @param [in] wake_addr - address server thread is waiting on
+   * @param [in] config - router configuration
+   *
+   * @return bool - True on success, false otherwise.
+   */
+  bool Init(int port_num, SOCKET wake_sock, const sockaddr_in& wake_addr, const RouterConfig& config = RouterConfig());
+
+  /**
+   * @brief Send command to router, may be called only from server thread.
+   *
+   * @param [in] command - command
+   */
+  void PushCommand(router_command&& command);
+
+  /**
+   * @brief Get event produced by router, may be called only from server thread.
+   *
+   * @param [out] event - event
+   *
+   * @return bool - true if event is available, false otherwise.
+   */
+  bool PopEvent(router_event& event);
+
+  /**
+   * @brief Check if router produced events, may be called only from server thread.
+   *
+   * @return bool - true if events are waiting, false otherwise.
+   */
+  bool HasEvents() const;
+
+  /**
+   * @brief Check if router has no queued commands and events.
+   *
+   * @return bool - true if both queues are empty, false otherwise.
+   */
+  bool Idle() const;
+
+  /**
+   * @brief Rearm server thread wake-up, must be called before events are read.
+   */
+  void ClearWake();
+
+ private:
+  struct subscriber
+  {
+      uint32_t client_id;
+      int filter_id;
+      int conflate_flag;
+      int shm_flag;
+      int qos_flag;
+      int bridge_flag;
+      // Ring sequence at which connection of client was lost, resumed session reads ring from there
+      uint64_t resume_seq;
+  };
+
+  struct topic_entry
+  {
+      std::string topic;
+      std::vector<subscriber> subscribers;
+      std::unique_ptr<shm_transport::ShmRing> ring;
+  };
+
+  /**
+   * @brief Router Thread for handling commands of owned topics.
+   */
+  void RouterThread();
+
+  /**
+   * @brief Handle single command.
+   *
+   * @param [in] command - command
+   */
+  void HandleCommand(router_command& command);
+
+  /**
+   * @brief Publish message to subscribers of topic whose filter matches.
+   *
+   * @param [in] command - publish command
+   */
+  void Publish(router_command& command);
+
+  /**
+   * @brief Subscribe client to topic, existing subscription of client to the topic is replaced.
+   *
+   * @param [in] command - subscribe command
+   */
+  void Subscribe(router_command& command);
+
+  /**
+   * @brief Unsubscribe client from topic.
+   *
+   * @param [in] command - unsubscribe command
+   */
+  void Unsubscribe(router_command& command);
+
+  /**
+   * @brief Remove all subscriptions of client.
+   *
+   * @param [in] client_id - client id
+   */
+  void RemoveClient(uint32_t client_id);
+
+  /**
+   * @brief Remember ring positions of client whose connection was lost, its session is kept.
+   *
+   * @param [in] client_id - client id
+   */
+  void SuspendClient(uint32_t client_id);
+
+  /**
+   * @brief Announce shared memory rings of resumed session again, new connection has none open.
+   *
+   * @param [in] command - resume command, shm_flag tells if new connection can use shared memory
+   */
+  void ResumeClient(router_command& command);
+
+  /**
+   * @brief Detach subscriber from topic ring, ring is freed with the last subscriber.
+   *
+   * @param [in] entry - topic entry
+   * @param [in] sub - subscriber
+   */
+  void DetachShm(topic_entry& entry, subscriber& sub);
+
+  /**
+   * @brief Count subscribers of topic that are not bridges.
+   *
+   * @param [in] entry - topic entry
+   *
+   * @return int - number of local subscribers.
+   */
+  int LocalSubscriberCount(const topic_entry& entry) const;
+
+  /**
+   * @brief Report change of local interest in topic, so that bridges forward topic only when needed.
+   *
+   * @param [in] topic - topic
+   * @param [in] count_before - number of local subscribers before change
+   * @param [in] count_after - number of local subscribers after change
+   */
+  void UpdateInterest(const std::string& topic, int count_before, int count_after);
+
+  /**
+   * @brief Send event to server thread and wake it up.
+   *
+   * @param [in] event - event
+   */
+  void PushEvent(router_event&& event);
+
+  /**
+   * @brief Move events kept while event queue was full to the queue, as far as there is room.
+   */
+  void FlushOverflowEvents();
+
+  /**
+   * @brief Wake up server thread, unless it was already woken and did not read events yet.
+   */
+  void WakeServer();
+
+  std::unordered_map<std::string, topic_entry> _topics;
+  filter_handler::FilterHandler _filter_handler;
+
+  spsc_queue::SpscQueue<router_command> _commands;
+  spsc_queue::SpscQueue<router_event> _events;
+
+  // Events that did not fit to full event queue, router never blocks on server thread
+  std::deque<router_event> _overflow_events;
+  std::atomic<size_t> _overflow_num{0};
+
+  std::thread _router_thread;
+  std::atomic<bool> _running;
+
+  // Router thread sleeps only after spinning on empty queue
+  std::mutex _sleep_mutex;
+  std::condition_variable _sleep_cond;
+  std::atomic<bool> _sleeping;
+
+  SOCKET _wake_sock;
+  sockaddr_in _wake_addr;
+  std::atomic<bool> _wake_pending;
+
+  int _port_num;
+  RouterConfig _config;
+};
+
+class ConsistentHash {
+ public:
+  /**
+   * @brief Constructor
+   */
+  ConsistentHash() = default;
+
+  /**
+   * @brief Build hash ring.
+   *
+   * @param [in] router_num - number of routers
+   */
+  void Init(int router_num);
+
+  /**
+   * @brief Find router owning topic.
+   *
+   * @param [in] topic - string topic
+   *
+   * @return int - router index.
+   */
+  int RouterFor(const std::string& topic) const;
+
+ private:
+  std::vector<std::pair<uint64_t, int>> _ring;
+};
+
+}  // namespace router_handler
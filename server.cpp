@@ -10,17 +10,38 @@
 
 /*----- Includes -----*/
 #include "server.h"
+#include "frame.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
 
 namespace {
 
 constexpr auto kMaxClientNum = 5;
+constexpr auto kMaxBatchSize = 16 * 1024;
+constexpr auto kMaxSendBufferSize = 8 * 1024 * 1024;
+constexpr auto kMaxCommandSize = 64 * 1024;
+constexpr auto kPeerRetryInterval = std::chrono::seconds(1);
+constexpr auto kQosWindowSize = 64;
+constexpr auto kMaxQosQueueSize = 4096;
+constexpr auto kQosDropLogInterval = 1000;
+constexpr auto kMaxSessionNum = 64;
+constexpr auto kMaxMissedMessageNum = 1024;
 
 /*----- Enums and Structures -----*/
 enum msg_type
 {
     COMMAND,
     TOPIC,
-    DATA
+    DATA,
+    FLAG
 };
 
 enum msg_command
@@ -28,13 +49,62 @@ enum msg_command
     PUBLISH,
     SUBSCRIBE,
     UNSUBSCRIBE,
+    CONNECT,
+    INTEREST,
+    ACK,
     INVALID_COMMAND
 };
 
+enum peer_state
+{
+    PEER_DOWN,
+    PEER_CONNECTING,
+    PEER_CONNECTED
+};
+
+struct str_qos_message
+{
+    uint32_t seq;
+    string message;
+};
+
+struct str_qos_subscription
+{
+    uint32_t next_seq;
+    // Messages from the front up to sent_num are in flight, the rest wait for window
+    deque<str_qos_message> messages;
+    size_t sent_num;
+    // Messages dropped because queue was full
+    uint64_t dropped_num;
+};
+
+struct str_queued_message
+{
+    string data;
+    // Steady clock microseconds, 0 if message never expires
+    uint64_t expiry_us;
+};
+
 struct str_client
 {
     SOCKET sock_handler;
-    string subscribe_topic;
+    uint32_t client_id;
+    // Id of connection, unlike client id it is not taken over by resumed session
+    uint32_t connection_id;
+    string client_name;
+    int shm_flag;
+    int bridge_flag;
+    frame_handler::frame_codec codec;
+    string send_buffer;
+    map<string, str_queued_message> conflated_messages;
+    // Messages waiting for socket to drain, one lane per priority
+    deque<str_queued_message> lanes[router_handler::PRIORITY_NUM];
+    size_t queued_bytes;
+    string batch_buffer;
+    map<string, str_qos_subscription> qos_subscriptions;
+    // Commands client state is restored from on hot restart
+    string connect_command;
+    map<string, string> subscribe_commands;
 };
 
 struct input_message
@@ -42,435 +112,2592 @@ struct input_message
     string commandInput;
     string topicInput;
     string dataInput;
+    string flagInput;
+};
+
+struct str_session
+{
+    uint32_t client_id;
+    map<string, str_qos_subscription> qos_subscriptions;
+    map<string, string> subscribe_commands;
+    // Messages published while client was disconnected, the oldest are dropped first
+    deque<str_queued_message> missed_messages;
+    map<string, str_queued_message> conflated_messages;
+    size_t dropped_num;
+    std::chrono::steady_clock::time_point expiry_time;
 };
 
-struct str_client _client_subscribe_list[kMaxClientNum];
+struct str_peer
+{
+    sockaddr_in addr;
+    SOCKET sock;
+    peer_state state;
+    std::chrono::steady_clock::time_point retry_time;
+};
+
+struct str_client _client_list[kMaxClientNum];
 struct input_message _received_input_message;
+map<SOCKET, frame_handler::FrameReader> _input_readers;
+uint32_t _next_client_id = 1;
+uint32_t _next_connection_id = 1;
+vector<str_peer> _peers;
+set<string> _local_topics;
+// Sessions of disconnected clients by client name, subscriptions stay on routers until session expires
+map<string, str_session> _sessions;
+unordered_map<uint32_t, string> _session_names;
  
 /*----- Helper Functions -----*/
 /**
- * @brief Initialization of the client subscribe list to default values.
+ * @brief Initialization of the client list to default values.
  */
-void initialize_client_subscribe_list(void)
+void initialize_client_list(void)
 {
     int i;
     
     for(i = 0; i < kMaxClientNum; ++i)
     {
-        _client_subscribe_list[i].sock_handler = INVALID_SOCKET;
-        _client_subscribe_list[i].subscribe_topic = "NO_TOPIC";
+        _client_list[i].sock_handler = INVALID_SOCKET;
+        _client_list[i].client_id = 0;
+        _client_list[i].connection_id = 0;
+        _client_list[i].shm_flag = 0;
+        _client_list[i].bridge_flag = 0;
+        _client_list[i].codec = frame_handler::CODEC_NONE;
+        _client_list[i].queued_bytes = 0;
     }
     
     cout << "Init Done" << endl;
 }
 
 /**
- * @brief Function add clients to subscribe list.
+ * @brief Function add clients to client list.
  * 
  * @param [in] client - socket
  */
-void add_client_to_subscribe_list(SOCKET client)
+void add_client_to_list(SOCKET client)
 {
     int i;
     
     for(i = 0; i < kMaxClientNum; ++i)
     {
-        if(_client_subscribe_list[i].sock_handler == INVALID_SOCKET)
+        if(_client_list[i].sock_handler == INVALID_SOCKET)
         {
-            _client_subscribe_list[i].sock_handler = client;
-            cout << "Client added to subscribe list" << endl;
+            // Client id is never reused, so stale deliveries of routers can not reach a new client
+            _client_list[i].sock_handler = client;
+            _client_list[i].client_id = _next_client_id++;
+            _client_list[i].connection_id = _next_connection_id++;
+            cout << "Client added to client list" << endl;
             break;
         }
     }
     
     if (i == kMaxClientNum)
     {
-        cout << "Client subscribe list full" << endl;
+        cout << "Client list full" << endl;
     }
 }
 
 /**
- * @brief Function remove clients from subscribe list.
+ * @brief Function finds client in client list.
  * 
  * @param [in] client - socket
+ *
+ * @return int - index in client list, -1 if client is not found.
  */
-void remove_client_from_subscribe_list(SOCKET client)
+int find_client(SOCKET client)
 {
     int i;
     
     for(i = 0; i < kMaxClientNum; ++i)
     {
-        if (_client_subscribe_list[i].sock_handler == client)
+        if(_client_list[i].sock_handler == client)
         {
-            _client_subscribe_list[i].sock_handler = INVALID_SOCKET;
-            _client_subscribe_list[i].subscribe_topic = "NO_TOPIC";
-            cout << "Client removed from subscribe list" << endl;
-            
-            break;
+            return i;
         }
     }
+    
+    return -1;
 }
 
 /**
- * @brief Function for parsing input message.
- * 
- * @param [in] buf - string buffer
+ * @brief Function finds client in client list by client id.
+ *
+ * @param [in] client_id - client id
+ *
+ * @return int - index in client list, -1 if client is not found.
  */
-void parse_input_message(string buf)
+int find_client_by_id(uint32_t client_id)
 {
-    size_t pos = 0;
-    int delimeterCount = 0;
-    string delimiter = " ";
-    string commandPart;
-    
-    cout << "Parse input message" << endl;
-    
-    while (((pos = buf.find(delimiter)) != string::npos) || (buf.empty() == 0)) 
+    int i;
+
+    for(i = 0; i < kMaxClientNum; ++i)
     {
-        if(pos != string::npos)
-        {
-            commandPart = buf.substr(0, pos);
-        }
-        else
-        {
-            commandPart = buf;
-        }
-        
-        switch(delimeterCount)
-        {
-            case COMMAND:
-            {
-                _received_input_message.commandInput = commandPart;
-                
-                break;
-            }
-            case TOPIC:
-            {
-                _received_input_message.topicInput = commandPart;
-                
-                break;
-            }
-            case DATA:
-            {
-                _received_input_message.dataInput = commandPart;
-                
-                break;
-            }
-            default:
-            {
-                cout << "Invalid part of message" << endl;
-            }
-        }
-        
-        cout << "Client sent: " << commandPart << endl;
-        
-        if(pos != string::npos)
-        {
-            buf.erase(0, pos + delimiter.length());
-        }
-        else
+        if((_client_list[i].sock_handler != INVALID_SOCKET) && (_client_list[i].client_id == client_id))
         {
-            buf.clear();
+            return i;
         }
-
-        delimeterCount++;
     }
-    
+
+    return -1;
 }
 
 /**
- * @brief Function for subscribing client to specific topic.
- * 
- * @param [in] sock - socket
- * @param [in] topic - string topic
+ * @brief Function finds connection id of client socket.
+ *
+ * @param [in] client - socket
+ *
+ * @return uint32_t - connection id, 0 if client is not in client list.
  */
-void subscribe(SOCKET sock, string topic)
+uint32_t find_connection_id(SOCKET client)
 {
-    int i;
-    
-    for(i = 0; i < kMaxClientNum; ++i)
+    int i = find_client(client);
+
+    return (i >= 0) ? _client_list[i].connection_id : 0;
+}
+
+/**
+ * @brief Function remove clients from client list.
+ *
+ * @param [in] client - socket
+ */
+void remove_client_from_list(SOCKET client)
+{
+    int i = find_client(client);
+
+    if(i < 0)
     {
-        if(_client_subscribe_list[i].sock_handler == sock)
-        {
-            _client_subscribe_list[i].subscribe_topic = topic;
-            cout << "Topic Subscribed" << endl;
-            
-            break;
-        }
+        return;
+    }
+
+    _client_list[i].sock_handler = INVALID_SOCKET;
+    _client_list[i].client_id = 0;
+    _client_list[i].connection_id = 0;
+    _client_list[i].client_name.clear();
+    _client_list[i].shm_flag = 0;
+    _client_list[i].bridge_flag = 0;
+    _client_list[i].codec = frame_handler::CODEC_NONE;
+    _client_list[i].send_buffer.clear();
+    _client_list[i].conflated_messages.clear();
+    for(auto &lane : _client_list[i].lanes)
+    {
+        lane.clear();
     }
+    _client_list[i].queued_bytes = 0;
+    _client_list[i].batch_buffer.clear();
+    _client_list[i].qos_subscriptions.clear();
+    _client_list[i].connect_command.clear();
+    _client_list[i].subscribe_commands.clear();
+    cout << "Client removed from client list" << endl;
 }
 
 /**
- * @brief Function for unsubscribing client from specific topic.
- * 
+ * @brief Function sets socket to blocking or non-blocking mode.
+ *
  * @param [in] sock - socket
- * @param [in] topic - string topic
+ * @param [in] blocking - 1 for blocking mode, 0 for non-blocking mode
  */
-void unsubscribe(SOCKET sock, string topic)
+void set_socket_blocking(SOCKET sock, int blocking)
 {
-    int i;
-    
-    for(i = 0; i < kMaxClientNum; ++i)
-    {
-        if((_client_subscribe_list[i].sock_handler == sock) && (_client_subscribe_list[i].subscribe_topic == topic))
-        {
-            _client_subscribe_list[i].subscribe_topic = "NO_TOPIC";
-            cout << "Topic Unsubscribed" << endl;
-            
-            break;
-        }
-    }
+    unsigned long mode = blocking ? 0 : 1;
+
+    ioctlsocket(sock, FIONBIO, &mode);
 }
 
 /**
- * @brief Function for checking is the client subscribed to specific topic.
- * 
+ * @brief Function configures socket for low latency, small messages are sent without delay.
+ *
  * @param [in] sock - socket
- * @param [in] topic - string topic
+ * @param [in] busy_poll_us - microseconds the network stack busy-polls on receive
+ */
+void configure_low_latency_socket(SOCKET sock, int busy_poll_us)
+{
+    int nodelay = 1;
+
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&nodelay, sizeof(nodelay));
+
+#ifdef SO_BUSY_POLL
+    setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, (const char*)&busy_poll_us, sizeof(busy_poll_us));
+#else
+    (void)busy_poll_us;
+#endif
+}
+
+/**
+ * @brief Function returns current steady clock time, message expiry times are measured on it.
+ *
+ * @return uint64_t - microseconds.
+ */
+uint64_t now_us(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Function checks if message expired.
+ *
+ * @param [in] expiry_us - expiry time, 0 if message never expires
+ *
+ * @return int - 1 if message expired, otherwise 0.
+ */
+int is_expired(uint64_t expiry_us)
+{
+    return ((expiry_us != 0) && (expiry_us <= now_us())) ? 1 : 0;
+}
+
+/**
+ * @brief Function sends bytes to client without breaking output that is waiting for socket to drain.
+ *        While socket is not writable bytes are queued in the lane of their priority.
+ * 
+ * @param [in] i - index in client list
+ * @param [in] data - bytes to send
+ * @param [in] length - number of bytes
+ * @param [in] priority - lane used while socket is not writable
+ * @param [in] expiry_us - expiry time, 0 if bytes never expire
+ * @param [in] reliable - 1 if bytes must not be dropped when send buffer is full, acknowledged
+ *                        messages are bounded by their in-flight window instead
  *
- * @return int - 1 if client subscribed, otherwise 0.
+ * @return int - 1 if bytes are sent or queued, 0 if they are dropped.
  */
-int is_client_subscribed_to_publish_topic(SOCKET sock, string topic)
+int send_raw(int i, const char *data, size_t length,
+             router_handler::message_priority priority = router_handler::PRIORITY_NORMAL, uint64_t expiry_us = 0,
+             int reliable = 0)
 {
+    struct str_client *client = &_client_list[i];
     
-    int retval = 0;
-    int i;
+    if(is_expired(expiry_us))
+    {
+        return 0;
+    }
     
-    for(i = 0; i < kMaxClientNum; ++i)
+    // Queue behind output waiting for socket to drain, it is flushed when socket is writable
+    if(!client->send_buffer.empty() || (client->queued_bytes > 0))
     {
-        if((_client_subscribe_list[i].sock_handler == sock) && (_client_subscribe_list[i].subscribe_topic.compare(topic) == 0))
+        if(!reliable && (client->send_buffer.size() + client->queued_bytes + length > kMaxSendBufferSize))
         {
-            retval = 1;
-            cout << "Subscribe topic found" << endl;
+            cout << "Send buffer full, message dropped" << endl;
+            return 0;
         }
+
+        client->lanes[priority].push_back({string(data, length), expiry_us});
+        client->queued_bytes += length;
+        return 1;
     }
     
-    return retval;
+    int bytesOut = send(client->sock_handler, data, length, 0);
+    
+    if(bytesOut == SOCKET_ERROR)
+    {
+        // Connection error is handled on receive
+        if(WSAGetLastError() != WSAEWOULDBLOCK)
+        {
+            return 0;
+        }
+
+        client->lanes[priority].push_back({string(data, length), expiry_us});
+        client->queued_bytes += length;
+    }
+    else if((size_t)bytesOut < length)
+    {
+        // Started message has to be completed first to keep the stream intact
+        client->send_buffer.assign(data + bytesOut, length - bytesOut);
+    }
+
+    return 1;
 }
 
 /**
- * @brief Funtion converts input string to enum.
- * 
- * @param [in] input - string input
+ * @brief Function moves next queued message to send buffer. Lanes are served by priority,
+ *        conflated messages go after high priority lane. Expired messages are dropped.
  *
- * @return msg_command - enum.
+ * @param [in] i - index in client list
+ * @param [out] conflated_topic - topic of conflated message, empty for message of lane
+ * @param [out] lane - lane of message
+ * @param [out] expiry_us - expiry time of message
+ *
+ * @return int - 1 if message is moved, 0 if nothing is queued.
  */
-msg_command resolveCommand(string input)
+int take_queued_message(int i, string &conflated_topic, int &lane, uint64_t &expiry_us)
 {
-    if(input.compare("PUBLISH") == 0) return PUBLISH;
-    if(input.compare("SUBSCRIBE") == 0) return SUBSCRIBE;
-    if(input.compare("UNSUBSCRIBE") == 0) return UNSUBSCRIBE;
-    
-    return INVALID_COMMAND;
-}
-
-}  // namespace
+    struct str_client *client = &_client_list[i];
 
-using namespace std;
+    for(lane = 0; lane < router_handler::PRIORITY_NUM; lane++)
+    {
+        while((lane == router_handler::PRIORITY_NORMAL) && !client->conflated_messages.empty())
+        {
+            auto slot = client->conflated_messages.begin();
 
-namespace server_handler {
+            if(is_expired(slot->second.expiry_us))
+            {
+                client->conflated_messages.erase(slot);
+                continue;
+            }
 
-ServerHandler::~ServerHandler() {
-    _server_thread.join();
+            conflated_topic = slot->first;
+            client->send_buffer.swap(slot->second.data);
+            expiry_us = slot->second.expiry_us;
+            client->conflated_messages.erase(slot);
+            return 1;
+        }
 
-    // Cleanup winsock
-	WSACleanup();
-}
+        deque<str_queued_message> &queue = client->lanes[lane];
 
-bool ServerHandler::Init(int port_number){
-    _port_num = port_number;
+        while(!queue.empty())
+        {
+            str_queued_message &message = queue.front();
+            client->queued_bytes -= message.data.size();
 
-    if(!InitializeWinSock()){
-        return false;
-    }
+            // Message expired while socket was not writable, it is never written
+            if(!is_expired(message.expiry_us))
+            {
+                client->send_buffer.swap(message.data);
+                expiry_us = message.expiry_us;
+                queue.pop_front();
+                return 1;
+            }
 
-    if(!CreateListeningSocket()){
-        return false;
+            queue.pop_front();
+        }
     }
 
-    _server_thread = std::thread(ServerThread, this);
-
-    return true;
+    return 0;
 }
 
-bool ServerHandler::InitializeWinSock(){
-    bool ret = true;
-
-	WSADATA wsData;
-	WORD ver = MAKEWORD(2, 2);
+/**
+ * @brief Function sends buffered output, queued and conflated messages until socket would block.
+ *
+ * @param [in] i - index in client list
+ */
+void flush_pending_output(int i)
+{
+    struct str_client *client = &_client_list[i];
 
-	int wsOk = WSAStartup(ver, &wsData);
-	if (wsOk != 0)
-	{
-		cerr << "Can't Initialize winsock!" << endl;
-		ret = false;
-	}
+    while(1)
+    {
+        string conflated_topic;
+        int lane = -1;
+        uint64_t expiry_us = 0;
 
-    return ret;
-}
+        // Buffered output has to be completed first to keep the stream intact
+        if(client->send_buffer.empty() && !take_queued_message(i, conflated_topic, lane, expiry_us))
+        {
+            break;
+        }
 
-bool ServerHandler::CreateListeningSocket(){
-    bool ret = true;
+        int bytesOut = send(client->sock_handler, client->send_buffer.c_str(), client->send_buffer.size(), 0);
+        if(bytesOut == SOCKET_ERROR)
+        {
+            if(WSAGetLastError() == WSAEWOULDBLOCK)
+            {
+                // Nothing of conflated message was sent, keep it overwritable
+                if(!conflated_topic.empty())
+                {
+                    client->conflated_messages[conflated_topic] = {std::move(client->send_buffer), expiry_us};
+                    client->send_buffer.clear();
+                }
+                // Nothing of queued message was sent, it can still expire or be overtaken by higher priority
+                else if(lane >= 0)
+                {
+                    client->queued_bytes += client->send_buffer.size();
+                    client->lanes[lane].push_front({std::move(client->send_buffer), expiry_us});
+                    client->send_buffer.clear();
+                }
+            }
+            else
+            {
+                // Connection error is handled on receive, drop pending data
+                client->send_buffer.clear();
+                client->conflated_messages.clear();
+                for(auto &queue : client->lanes)
+                {
+                    queue.clear();
+                }
+                client->queued_bytes = 0;
+            }
 
-	// Create a listening socket
-	_listening = socket(AF_INET, SOCK_STREAM, 0);
-	if (_listening == INVALID_SOCKET)
-	{
-		cerr << "Can't create a socket" << endl;
-		return 0;
-	}
+            break;
+        }
 
-    return ret;
+        client->send_buffer.erase(0, bytesOut);
+    }
 }
 
-void ServerHandler::ServerThread(){
-    // Bind the ip address and port to a socket
-	sockaddr_in hint;
-	hint.sin_family = AF_INET;
-	hint.sin_port = htons(_port_num);
-	hint.sin_addr.S_un.S_addr = INADDR_ANY; 
-	
-	bind(_listening, (sockaddr*)&hint, sizeof(hint));
+/**
+ * @brief Function sends message to conflating client.
+ *        While socket is not writable only the latest message of topic is kept, older one is overwritten.
+ *
+ * @param [in] i - index in client list
+ * @param [in] topic - string topic
+ * @param [in] message - message including terminating null character or frame
+ * @param [in] expiry_us - expiry time, 0 if message never expires
+ */
+void send_conflated_message(int i, const string &topic, const string &message, uint64_t expiry_us)
+{
+    struct str_client *client = &_client_list[i];
 
-	// Set socket for listening 
-	listen(_listening, SOMAXCONN);
+    // Overwrite pending slot in place
+    str_queued_message &slot = client->conflated_messages[topic];
+    slot.data = message;
+    slot.expiry_us = expiry_us;
 
-	// Create file descriptor and zero it
-	fd_set master;
-	FD_ZERO(&master);
+    // Socket is known to be unwritable, wait for select() to report it drained
+    if(!client->send_buffer.empty() || (client->queued_bytes > 0))
+    {
+        return;
+    }
 
-	// Add listening socket to file descriptor
+    flush_pending_output(i);
+}
+
+/**
+ * @brief Function checks whether client has output waiting for socket to become writable.
+ *
+ * @param [in] i - index in client list
+ *
+ * @return int - 1 if output is pending, otherwise 0.
+ */
+int has_pending_output(int i)
+{
+    return (!_client_list[i].send_buffer.empty() || !_client_list[i].conflated_messages.empty() ||
+            (_client_list[i].queued_bytes > 0)) ? 1 : 0;
+}
+
+/**
+ * @brief Function sends batched messages to client as one frame, compressed if worthwhile.
+ * 
+ * @param [in] i - index in client list
+ */
+void flush_batch(int i)
+{
+    struct str_client *client = &_client_list[i];
+    
+    if(client->batch_buffer.empty())
+    {
+        return;
+    }
+    
+    string frame = frame_handler::EncodeFrame(client->codec, client->batch_buffer);
+    client->batch_buffer.clear();
+    
+    send_raw(i, frame.c_str(), frame.size());
+}
+
+/**
+ * @brief Function adds small message to client batch, batch is sent when it is full or at the end of server loop.
+ * 
+ * @param [in] i - index in client list
+ * @param [in] message - message including terminating null character
+ */
+void add_message_to_batch(int i, const string &message)
+{
+    _client_list[i].batch_buffer += message;
+    
+    if(_client_list[i].batch_buffer.size() >= kMaxBatchSize)
+    {
+        flush_batch(i);
+    }
+}
+
+/**
+ * @brief Function sends single message to client in the format negotiated at connect.
+ * 
+ * @param [in] i - index in client list
+ * @param [in] message - message without terminating null character
+ * @param [in] priority - lane used while socket is not writable, server messages are control traffic
+ * @param [in] expiry_us - expiry time, 0 if message never expires
+ * @param [in] reliable - 1 if message must not be dropped when send buffer is full
+ *
+ * @return int - 1 if message is sent or queued, 0 if it is dropped.
+ */
+int send_message(int i, const string &message,
+                 router_handler::message_priority priority = router_handler::PRIORITY_CONTROL, uint64_t expiry_us = 0,
+                 int reliable = 0)
+{
+    struct str_client *client = &_client_list[i];
+    string messageOut(message.c_str(), message.size() + 1);
+    
+    if(client->codec == frame_handler::CODEC_NONE)
+    {
+        return send_raw(i, messageOut.c_str(), messageOut.size(), priority, expiry_us, reliable);
+    }
+    
+    // Batched messages were published earlier and have to be sent first
+    flush_batch(i);
+    
+    string frame = frame_handler::EncodeFrame(client->codec, messageOut);
+    return send_raw(i, frame.c_str(), frame.size(), priority, expiry_us, reliable);
+}
+
+/**
+ * @brief Function delivers published message to client.
+ * 
+ * @param [in] i - index in client list
+ * @param [in] topic - string topic
+ * @param [in] conflate - 1 if client conflates topic, otherwise 0
+ * @param [in] messageOut - message including terminating null character
+ * @param [in,out] sharedFrame - frame for clients that negotiated compression, encoded once per publish
+ * @param [in] priority - priority class of message
+ * @param [in] expiry_us - expiry time, 0 if message never expires
+ */
+void deliver_message(int i, const string &topic, int conflate, const string &messageOut, string &sharedFrame,
+                     router_handler::message_priority priority, uint64_t expiry_us)
+{
+    struct str_client *client = &_client_list[i];
+    
+    if((client->codec != frame_handler::CODEC_NONE) && sharedFrame.empty())
+    {
+        sharedFrame = frame_handler::EncodeFrame(frame_handler::CODEC_LZ4, messageOut);
+    }
+    
+    if(conflate)
+    {
+        send_conflated_message(i, topic, (client->codec != frame_handler::CODEC_NONE) ? sharedFrame : messageOut, expiry_us);
+    }
+    else if(client->codec == frame_handler::CODEC_NONE)
+    {
+        send_raw(i, messageOut.c_str(), messageOut.size(), priority, expiry_us);
+    }
+    else if((messageOut.size() < frame_handler::kCompressMinSize) && (priority == router_handler::PRIORITY_NORMAL) &&
+            (expiry_us == 0))
+    {
+        // Small messages are batched and compressed together, batch is sent in normal lane
+        add_message_to_batch(i, messageOut);
+    }
+    else
+    {
+        flush_batch(i);
+        send_raw(i, sharedFrame.c_str(), sharedFrame.size(), priority, expiry_us);
+    }
+}
+
+/**
+ * @brief Function sends queued messages of acknowledged subscription while in-flight window is not full.
+ *
+ * @param [in] i - index in client list
+ * @param [in,out] sub - acknowledged subscription
+ */
+void send_qos_window(int i, str_qos_subscription &sub)
+{
+    while((sub.sent_num < sub.messages.size()) && (sub.sent_num < kQosWindowSize))
+    {
+        // Message counts as sent only when it is written or queued, so that it is not acknowledged past a gap
+        if(!send_message(i, sub.messages[sub.sent_num].message, router_handler::PRIORITY_NORMAL, 0, 1))
+        {
+            break;
+        }
+
+        sub.sent_num++;
+    }
+}
+
+/**
+ * @brief Function queues published message of acknowledged subscription, message gets sequence number of subscription.
+ *        Message is dropped when queue is full, its sequence number is skipped so that client sees a gap.
+ *
+ * @param [in,out] sub - acknowledged subscription
+ * @param [in] topic - string topic
+ * @param [in] data - published data
+ */
+void enqueue_qos_message(str_qos_subscription &sub, const string &topic, const string &data)
+{
+    uint32_t seq = ++sub.next_seq;
+
+    if(sub.messages.size() >= kMaxQosQueueSize)
+    {
+        // Log first drop and then every kQosDropLogInterval drops, a stalled client must not flood the log
+        if((sub.dropped_num++ % kQosDropLogInterval) == 0)
+        {
+            cout << "QoS queue of topic " << topic << " full, " << sub.dropped_num << " messages dropped" << endl;
+        }
+
+        return;
+    }
+
+    ostringstream ss;
+    ss << "[Message] Topic: " << topic << " Seq: " << seq << " Data: " << data << endl;
+    sub.messages.push_back({seq, ss.str()});
+}
+
+/**
+ * @brief Function delivers published message to acknowledged subscription.
+ *
+ * @param [in] i - index in client list
+ * @param [in] topic - string topic
+ * @param [in] data - published data
+ */
+void deliver_qos_message(int i, const string &topic, const string &data)
+{
+    str_qos_subscription &sub = _client_list[i].qos_subscriptions[topic];
+
+    enqueue_qos_message(sub, topic, data);
+    send_qos_window(i, sub);
+}
+
+/**
+ * @brief Function releases messages up to cumulative acknowledgement and sends the ones waiting for window.
+ *
+ * @param [in] i - index in client list
+ * @param [in] topic - string topic
+ * @param [in] seq - sequence number of the last received message
+ */
+void acknowledge_qos_messages(int i, const string &topic, uint32_t seq)
+{
+    auto it = _client_list[i].qos_subscriptions.find(topic);
+
+    if(it == _client_list[i].qos_subscriptions.end())
+    {
+        return;
+    }
+
+    str_qos_subscription &sub = it->second;
+
+    // Only sent messages can be acknowledged
+    while((sub.sent_num > 0) && (sub.messages.front().seq <= seq))
+    {
+        sub.messages.pop_front();
+        sub.sent_num--;
+    }
+
+    send_qos_window(i, sub);
+}
+
+/**
+ * @brief Function ends acknowledged subscription. Its sequence number is kept, because client drops
+ *        messages with sequence numbers it already received, so renewed subscription has to continue it.
+ *
+ * @param [in] i - index in client list
+ * @param [in] topic - string topic
+ */
+void end_qos_subscription(int i, const string &topic)
+{
+    auto it = _client_list[i].qos_subscriptions.find(topic);
+
+    if(it == _client_list[i].qos_subscriptions.end())
+    {
+        return;
+    }
+
+    it->second.messages.clear();
+    it->second.sent_num = 0;
+}
+
+/**
+ * @brief Function keeps session of disconnected client, so that subscriptions survive until it reconnects.
+ *
+ * @param [in] i - index in client list
+ * @param [in] expiry - session expiry in seconds, 0 if sessions are disabled
+ *
+ * @return int - 1 if session is kept, otherwise 0.
+ */
+int detach_session(int i, int expiry)
+{
+    struct str_client *client = &_client_list[i];
+
+    // Bridges restore their state from interest snapshot, name of an active session can be reused only once
+    if((expiry <= 0) || client->client_name.empty() || client->bridge_flag ||
+       (_sessions.count(client->client_name) > 0) || (_sessions.size() >= kMaxSessionNum))
+    {
+        return 0;
+    }
+
+    str_session &session = _sessions[client->client_name];
+    session.client_id = client->client_id;
+    session.dropped_num = 0;
+    session.expiry_time = std::chrono::steady_clock::now() + std::chrono::seconds(expiry);
+    session.qos_subscriptions.swap(client->qos_subscriptions);
+    session.subscribe_commands.swap(client->subscribe_commands);
+
+    for(auto &sub : session.qos_subscriptions)
+    {
+        // Nothing is known to be received after connection is lost
+        sub.second.sent_num = 0;
+    }
+
+    _session_names[client->client_id] = client->client_name;
+
+    return 1;
+}
+
+/**
+ * @brief Function stores message published to client of disconnected session.
+ *
+ * @param [in,out] session - session of disconnected client
+ * @param [in] target - subscription the message is delivered to
+ * @param [in] topic - string topic
+ * @param [in] data - published data
+ * @param [in] message - formatted message without terminating null character
+ * @param [in] expiry_us - expiry time, 0 if message never expires
+ */
+void buffer_missed_message(str_session &session, const router_handler::router_target &target,
+                           const string &topic, const string &data, const string &message, uint64_t expiry_us)
+{
+    if(target.qos_flag)
+    {
+        enqueue_qos_message(session.qos_subscriptions[topic], topic, data);
+        return;
+    }
+
+    if(target.conflate_flag)
+    {
+        session.conflated_messages[topic] = {message, expiry_us};
+        return;
+    }
+
+    if(session.missed_messages.size() >= kMaxMissedMessageNum)
+    {
+        session.missed_messages.pop_front();
+        session.dropped_num++;
+    }
+
+    session.missed_messages.push_back({message, expiry_us});
+}
+
+/**
+ * @brief Function parses unsigned 64 bit decimal number, untrusted input must never throw.
+ *
+ * @param [in] input - string input
+ * @param [out] value - parsed number
+ *
+ * @return int - 1 if whole input is a number in 64 bit range, otherwise 0.
+ */
+int parse_uint64(const string &input, uint64_t &value)
+{
+    char *end = nullptr;
+
+    if(input.empty() || (input.find_first_not_of("0123456789") != string::npos))
+    {
+        return 0;
+    }
+
+    errno = 0;
+    unsigned long long number = strtoull(input.c_str(), &end, 10);
+
+    if((errno == ERANGE) || (*end != '\0') || (number > UINT64_MAX))
+    {
+        return 0;
+    }
+
+    value = (uint64_t)number;
+
+    return 1;
+}
+
+/**
+ * @brief Function parses unsigned 32 bit decimal number, untrusted input must never throw.
+ *
+ * @param [in] input - string input
+ * @param [out] value - parsed number
+ *
+ * @return int - 1 if whole input is a number in 32 bit range, otherwise 0.
+ */
+int parse_uint32(const string &input, uint32_t &value)
+{
+    uint64_t number = 0;
+
+    if(!parse_uint64(input, number) || (number > UINT32_MAX))
+    {
+        return 0;
+    }
+
+    value = (uint32_t)number;
+
+    return 1;
+}
+
+/**
+ * @brief Function checks if capability is in comma separated capability list.
+ * 
+ * @param [in] capabilities - comma separated capabilities
+ * @param [in] capability - capability to find
+ *
+ * @return int - 1 if capability is found, otherwise 0.
+ */
+int has_capability(string capabilities, string capability)
+{
+    return (("," + capabilities + ",").find("," + capability + ",") != string::npos) ? 1 : 0;
+}
+
+/**
+ * @brief Function parses comma separated publish options, time to live in milliseconds and priority class
+ *        (example: TTL=500,HIGH).
+ *
+ * @param [in] options - publish options
+ * @param [in,out] command - publish command that gets priority and expiry time
+ *
+ * @return int - 1 on success, 0 if option is invalid.
+ */
+int parse_publish_options(const string &options, router_handler::router_command &command)
+{
+    istringstream iss(options);
+    string option;
+
+    while(getline(iss, option, ','))
+    {
+        if(option.compare(0, 4, "TTL=") == 0)
+        {
+            char *end = nullptr;
+            long ttl_ms = strtol(option.c_str() + 4, &end, 10);
+
+            if((*end != '\0') || (ttl_ms <= 0))
+            {
+                return 0;
+            }
+
+            command.expiry_us = now_us() + (uint64_t)ttl_ms * 1000;
+        }
+        else if(option.compare("HIGH") == 0)
+        {
+            command.priority = router_handler::PRIORITY_HIGH;
+        }
+        else if(option.compare("NORMAL") == 0)
+        {
+            command.priority = router_handler::PRIORITY_NORMAL;
+        }
+        else if(option.compare("BULK") == 0)
+        {
+            command.priority = router_handler::PRIORITY_BULK;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Function formats publish options of message forwarded to bridged server, time to live is what is left of it.
+ *
+ * @param [in] priority - priority class of message
+ * @param [in] expiry_us - expiry time, 0 if message never expires
+ *
+ * @return string - publish options, empty for defaults.
+ */
+string format_publish_options(router_handler::message_priority priority, uint64_t expiry_us)
+{
+    string options;
+
+    if(expiry_us != 0)
+    {
+        uint64_t now = now_us();
+        options = "TTL=" + to_string((expiry_us > now) ? (expiry_us - now + 999) / 1000 : 1);
+    }
+
+    if(priority == router_handler::PRIORITY_HIGH)
+    {
+        options += options.empty() ? "HIGH" : ",HIGH";
+    }
+    else if(priority == router_handler::PRIORITY_BULK)
+    {
+        options += options.empty() ? "BULK" : ",BULK";
+    }
+
+    return options;
+}
+
+/**
+ * @brief Function sends all topics with local subscribers to bridged server.
+ *
+ * @param [in] i - index in client list
+ */
+void send_interest_snapshot(int i)
+{
+    for(const string &topic : _local_topics)
+    {
+        send_message(i, "INTEREST " + topic + " +");
+    }
+}
+
+/**
+ * @brief Function sends change of local interest in topic to all bridged servers.
+ *
+ * @param [in] topic - string topic
+ * @param [in] interest - 1 if topic got local subscriber, 0 if it lost the last one
+ */
+void broadcast_interest(const string &topic, int interest)
+{
+    int i;
+
+    for(i = 0; i < kMaxClientNum; ++i)
+    {
+        if((_client_list[i].sock_handler != INVALID_SOCKET) && _client_list[i].bridge_flag)
+        {
+            send_message(i, "INTEREST " + topic + (interest ? " +" : " -"));
+        }
+    }
+}
+
+/**
+ * @brief Function parses peer address given as host:port or port, host defaults to loopback.
+ *
+ * @param [in] peer - peer address
+ * @param [out] addr - socket address
+ *
+ * @return int - 1 on success, otherwise 0.
+ */
+int parse_peer_address(const string &peer, sockaddr_in &addr)
+{
+    string host = "127.0.0.1";
+    string port = peer;
+    size_t pos = peer.rfind(':');
+
+    if(pos != string::npos)
+    {
+        host = peer.substr(0, pos);
+        port = peer.substr(pos + 1);
+    }
+
+    if(port.empty() || (port.find_first_not_of("0123456789") != string::npos))
+    {
+        return 0;
+    }
+
+    errno = 0;
+    long port_num = strtol(port.c_str(), nullptr, 10);
+
+    if((errno == ERANGE) || (port_num < 1) || (port_num > 65535))
+    {
+        return 0;
+    }
+
+    ZeroMemory(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port_num);
+    addr.sin_addr.s_addr = inet_addr(host.c_str());
+
+    return (addr.sin_addr.s_addr != INADDR_NONE) ? 1 : 0;
+}
+
+/**
+ * @brief Function stores client name and transport capabilities sent in CONNECT.
+ * 
+ * @param [in] sock - socket
+ * @param [in] name - client name
+ * @param [in] capabilities - comma separated capabilities
+ */
+void connect_client(SOCKET sock, string name, string capabilities)
+{
+    int i = find_client(sock);
+    
+    if(i < 0)
+    {
+        return;
+    }
+    
+    _client_list[i].client_name = name;
+    _client_list[i].shm_flag = 0;
+    
+    // Shared memory is only reachable by clients on the same host
+    sockaddr_in peer;
+    int peer_size = sizeof(peer);
+    int local_flag = (getpeername(sock, (sockaddr*)&peer, &peer_size) == 0) &&
+                     (peer.sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+    
+    if(local_flag && has_capability(capabilities, "SHM"))
+    {
+        _client_list[i].shm_flag = 1;
+    }
+    
+    // Confirm compression in text, all following messages are sent in binary frames
+    if(has_capability(capabilities, "LZ4") && (_client_list[i].codec == frame_handler::CODEC_NONE))
+    {
+        send_message(i, "[Transport] LZ4\n");
+        _client_list[i].codec = frame_handler::CODEC_LZ4;
+    }
+    
+    // Other server bridges to this one, it gets local interest and keeps it updated
+    if(has_capability(capabilities, "BRIDGE") && !_client_list[i].bridge_flag)
+    {
+        _client_list[i].bridge_flag = 1;
+        send_interest_snapshot(i);
+        cout << "Server " << name << " bridged" << endl;
+    }
+    
+    cout << "Client " << name << " connected" << endl;
+}
+
+/**
+ * @brief Function for parsing input message.
+ * 
+ * @param [in] buf - string buffer
+ */
+void parse_input_message(string buf)
+{
+    size_t pos = 0;
+    int delimeterCount = 0;
+    string delimiter = " ";
+    string commandPart;
+    
+    cout << "Parse input message" << endl;
+    
+    // Clear previous message so that optional parts are not carried over
+    _received_input_message = input_message();
+    
+    while (((pos = buf.find(delimiter)) != string::npos) || (buf.empty() == 0)) 
+    {
+        if(pos != string::npos)
+        {
+            commandPart = buf.substr(0, pos);
+        }
+        else
+        {
+            commandPart = buf;
+        }
+        
+        switch(delimeterCount)
+        {
+            case COMMAND:
+            {
+                _received_input_message.commandInput = commandPart;
+                
+                break;
+            }
+            case TOPIC:
+            {
+                _received_input_message.topicInput = commandPart;
+                
+                break;
+            }
+            case DATA:
+            {
+                _received_input_message.dataInput = commandPart;
+                
+                break;
+            }
+            case FLAG:
+            {
+                _received_input_message.flagInput = commandPart;
+                
+                break;
+            }
+            default:
+            {
+                cout << "Invalid part of message" << endl;
+            }
+        }
+        
+        cout << "Client sent: " << commandPart << endl;
+        
+        if(pos != string::npos)
+        {
+            buf.erase(0, pos + delimiter.length());
+        }
+        else
+        {
+            buf.clear();
+        }
+
+        delimeterCount++;
+    }
+    
+}
+
+/**
+ * @brief Function creates name of pipe running server hands over its sockets on.
+ *
+ * @param [in] port_num - server port number
+ *
+ * @return string - pipe name.
+ */
+string handoff_pipe_name(int port_num)
+{
+    return "\\\\.\\pipe\\pubsub_" + to_string(port_num);
+}
+
+/**
+ * @brief Function writes all bytes to pipe.
+ *
+ * @param [in] pipe - pipe handle
+ * @param [in] data - bytes to write
+ * @param [in] length - number of bytes
+ *
+ * @return int - 1 on success, otherwise 0.
+ */
+int write_pipe(HANDLE pipe, const void *data, size_t length)
+{
+    const char *bytes = (const char *)data;
+    DWORD written = 0;
+
+    while(length > 0)
+    {
+        if(!WriteFile(pipe, bytes, (DWORD)length, &written, nullptr))
+        {
+            return 0;
+        }
+
+        bytes += written;
+        length -= written;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Function reads exact number of bytes from pipe.
+ *
+ * @param [in] pipe - pipe handle
+ * @param [out] data - read bytes
+ * @param [in] length - number of bytes
+ *
+ * @return int - 1 on success, otherwise 0.
+ */
+int read_pipe(HANDLE pipe, void *data, size_t length)
+{
+    char *bytes = (char *)data;
+    DWORD bytes_read = 0;
+
+    while(length > 0)
+    {
+        if(!ReadFile(pipe, bytes, (DWORD)length, &bytes_read, nullptr) || (bytes_read == 0))
+        {
+            return 0;
+        }
+
+        bytes += bytes_read;
+        length -= bytes_read;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Function appends length prefixed entry to client state.
+ *
+ * @param [in,out] state - client state
+ * @param [in] entry - entry, may contain null characters
+ */
+void append_state_entry(string &state, const string &entry)
+{
+    uint32_t length = (uint32_t)entry.size();
+
+    state.append((const char *)&length, sizeof(length));
+    state += entry;
+}
+
+/**
+ * @brief Function reads next length prefixed entry of client state.
+ *
+ * @param [in] state - client state
+ * @param [in,out] pos - position of entry, moved to the next entry
+ * @param [out] entry - entry
+ *
+ * @return int - 1 if entry is read, 0 at the end of state.
+ */
+int read_state_entry(const string &state, size_t &pos, string &entry)
+{
+    uint32_t length = 0;
+
+    if(state.size() - pos < sizeof(length))
+    {
+        return 0;
+    }
+
+    memcpy(&length, state.data() + pos, sizeof(length));
+    pos += sizeof(length);
+
+    if(state.size() - pos < length)
+    {
+        return 0;
+    }
+
+    entry.assign(state, pos, length);
+    pos += length;
+
+    return 1;
+}
+
+/**
+ * @brief Function serializes client state for new server process.
+ *        Client is restored by replaying its commands, followed by unsent output, conflated slots, acknowledged subscriptions
+ *        and unread input.
+ *
+ * @param [in] i - index in client list
+ *
+ * @return string - client state.
+ */
+string serialize_client_state(int i)
+{
+    struct str_client *client = &_client_list[i];
+    string state;
+
+    if(!client->connect_command.empty())
+    {
+        append_state_entry(state, client->connect_command);
+    }
+
+    for(const auto &subscribe : client->subscribe_commands)
+    {
+        append_state_entry(state, subscribe.second);
+    }
+
+    // Queued messages follow started one in the order they would be flushed
+    string output = client->send_buffer;
+    for(const auto &lane : client->lanes)
+    {
+        for(const str_queued_message &message : lane)
+        {
+            if(!is_expired(message.expiry_us))
+            {
+                output += message.data;
+            }
+        }
+    }
+
+    if(!output.empty())
+    {
+        append_state_entry(state, "OUTPUT " + output);
+    }
+
+    // Conflated slots keep their topic, so that newer messages still overwrite them in new process
+    for(const auto &slot : client->conflated_messages)
+    {
+        if(!is_expired(slot.second.expiry_us))
+        {
+            append_state_entry(state, "CONFLATE " + slot.first + " " + to_string(slot.second.expiry_us) + " " + slot.second.data);
+        }
+    }
+
+    for(const auto &sub : client->qos_subscriptions)
+    {
+        append_state_entry(state, "QOS " + sub.first + " " + to_string(sub.second.next_seq));
+
+        for(const str_qos_message &message : sub.second.messages)
+        {
+            append_state_entry(state, "QOSMSG " + sub.first + " " + to_string(message.seq) + " " + message.message);
+        }
+    }
+
+    string input = _input_readers[client->sock_handler].Pending();
+    if(!input.empty())
+    {
+        append_state_entry(state, "INPUT " + input);
+    }
+
+    return state;
+}
+
+/**
+ * @brief Funtion converts input string to enum.
+ * 
+ * @param [in] input - string input
+ *
+ * @return msg_command - enum.
+ */
+msg_command resolveCommand(string input)
+{
+    if(input.compare("PUBLISH") == 0) return PUBLISH;
+    if(input.compare("SUBSCRIBE") == 0) return SUBSCRIBE;
+    if(input.compare("UNSUBSCRIBE") == 0) return UNSUBSCRIBE;
+    if(input.compare("CONNECT") == 0) return CONNECT;
+    if(input.compare("INTEREST") == 0) return INTEREST;
+    if(input.compare("ACK") == 0) return ACK;
+    
+    return INVALID_COMMAND;
+}
+
+}  // namespace
+
+using namespace std;
+
+namespace server_handler {
+
+ServerHandler::~ServerHandler() {
+    Shutdown();
+
+    if(_server_thread.joinable()){
+        _server_thread.join();
+    }
+
+    if(_handoff_thread.joinable()){
+        _handoff_thread.join();
+    }
+
+    // Cleanup winsock
+	WSACleanup();
+}
+
+bool ServerHandler::Init(int port_number, const ServerConfig& config){
+    _port_num = port_number;
+    _config = config;
+
+    if(_config.router_num < 1){
+        _config.router_num = 1;
+    }
+
+    // CPU must fit into affinity mask of the thread and exist on this machine
+    if(_config.io_cpu >= 0){
+        unsigned cpu_num = std::thread::hardware_concurrency();
+
+        if(((size_t)_config.io_cpu >= sizeof(DWORD_PTR) * 8) || ((cpu_num != 0) && ((unsigned)_config.io_cpu >= cpu_num))){
+            cerr << "Invalid I/O CPU " << _config.io_cpu << ", server thread is not pinned" << endl;
+            _config.io_cpu = -1;
+        }
+    }
+    else{
+        _config.io_cpu = -1;
+    }
+
+    if(!InitializeWinSock()){
+        return false;
+    }
+
+    if(!_config.capture_path.empty()){
+        if(!_capture.Open(_config.capture_path)){
+            cerr << "Can't create capture file " << _config.capture_path << endl;
+            return false;
+        }
+
+        cout << "Capturing commands to " << _config.capture_path << endl;
+    }
+
+    // New process takes over listening socket of running server instead of binding the port
+    if(_config.hot_restart){
+        if(!ReceiveHandoff()){
+            return false;
+        }
+    }
+    else if(!CreateListeningSocket()){
+        return false;
+    }
+
+    if(!CreateWakeSocket()){
+        return false;
+    }
+
+    // Routers busy-poll with server thread and are kept off the CPU of server thread
+    router_handler::RouterConfig router_config;
+    router_config.busy_poll = _config.low_latency;
+    if(_config.io_cpu >= 0){
+        unsigned cpu_num = std::thread::hardware_concurrency();
+        uint64_t all_cpus = ((cpu_num == 0) || (cpu_num >= 64)) ? ~0ULL : ((1ULL << cpu_num) - 1);
+        router_config.cpu_mask = all_cpus & ~(1ULL << _config.io_cpu);
+    }
+
+    // Start router threads, every topic is owned by exactly one router
+    _topic_hash.Init(_config.router_num);
+    for(int i = 0; i < _config.router_num; ++i){
+        _routers.emplace_back(new router_handler::RouterHandler());
+        _routers.back()->Init(_port_num, _wake_sock, _wake_addr, router_config);
+    }
+
+    cout << "Router threads: " << _config.router_num << endl;
+
+    // Peers are connected from server thread and reconnected when connection is lost
+    for(const string& peer : _config.peers){
+        str_peer entry;
+
+        if(!parse_peer_address(peer, entry.addr)){
+            cout << "Invalid peer address: " << peer << endl;
+            continue;
+        }
+
+        entry.sock = INVALID_SOCKET;
+        entry.state = PEER_DOWN;
+        entry.retry_time = std::chrono::steady_clock::now();
+        _peers.push_back(entry);
+    }
+
+    _running = true;
+    _server_thread = std::thread(ServerThread, this);
+
+    // Any running server can be taken over by a new process
+    _handoff_thread = std::thread(&ServerHandler::HandoffThread, this);
+
+    return true;
+}
+
+void ServerHandler::Shutdown(){
+    _running = false;
+
+    if(_server_thread.joinable()){
+        WakeServerThread();
+    }
+
+    // Handoff thread waits for a new process on pipe, connect to release it
+    string pipe_name = handoff_pipe_name(_port_num);
+    while(_handoff_thread.joinable() && !_handoff_finished){
+        HANDLE pipe = CreateFile(pipe_name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+        if(pipe != INVALID_HANDLE_VALUE){
+            CloseHandle(pipe);
+        }
+
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+}
+
+bool ServerHandler::IsRunning() const{
+    return _running;
+}
+
+void ServerHandler::WakeServerThread(){
+    char wake = 0;
+
+    sendto(_wake_sock, &wake, 1, 0, (sockaddr*)&_wake_addr, sizeof(_wake_addr));
+}
+
+bool ServerHandler::ReceiveHandoff(){
+    string pipe_name = handoff_pipe_name(_port_num);
+    HANDLE pipe = CreateFile(pipe_name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+
+    if(pipe == INVALID_HANDLE_VALUE){
+        cerr << "No running server to take over on port " << _port_num << endl;
+        return false;
+    }
+
+    // Request handoff, running server checks the id against the pipe client and duplicates sockets for it
+    DWORD pid = GetCurrentProcessId();
+    if(!write_pipe(pipe, &pid, sizeof(pid))){
+        CloseHandle(pipe);
+        return false;
+    }
+
+    _listening = INVALID_SOCKET;
+    bool complete = false;
+
+    while(1){
+        uint32_t kind = 0, codec = 0, length = 0;
+        WSAPROTOCOL_INFO info;
+
+        if(!read_pipe(pipe, &kind, sizeof(kind))){
+            break;
+        }
+
+        if(kind == 0){
+            complete = true;
+            break;
+        }
+
+        if(!read_pipe(pipe, &info, sizeof(info)) || !read_pipe(pipe, &codec, sizeof(codec)) ||
+           !read_pipe(pipe, &length, sizeof(length))){
+            break;
+        }
+
+        string state(length, '\0');
+        if((length > 0) && !read_pipe(pipe, &state[0], length)){
+            break;
+        }
+
+        SOCKET sock = WSASocket(FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, &info, 0, 0);
+        if(sock == INVALID_SOCKET){
+            cerr << "Can't take over socket, Err #" << WSAGetLastError() << endl;
+            continue;
+        }
+
+        if(kind == 1){
+            _listening = sock;
+        }
+        else{
+            _inherited.push_back({sock, (int)codec, state});
+        }
+    }
+
+    CloseHandle(pipe);
+
+    if(!complete || (_listening == INVALID_SOCKET)){
+        cerr << "Hot restart handoff failed" << endl;
+        return false;
+    }
+
+    cout << "Took over " << _inherited.size() << " clients" << endl;
+
+    return true;
+}
+
+void ServerHandler::HandoffThread(){
+    string pipe_name = handoff_pipe_name(_port_num);
+
+    while(_running){
+        // Previous process may still hold the pipe right after hot restart
+        HANDLE pipe = CreateNamedPipe(pipe_name.c_str(), PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+                                      1, 64 * 1024, 64 * 1024, 0, nullptr);
+        if(pipe == INVALID_HANDLE_VALUE){
+            this_thread::sleep_for(chrono::milliseconds(100));
+            continue;
+        }
+
+        bool connected = ConnectNamedPipe(pipe, nullptr) || (GetLastError() == ERROR_PIPE_CONNECTED);
+        DWORD pid = 0, client_pid = 0;
+
+        // Sockets are duplicated only for the process that is actually connected to the pipe
+        if(!_running || !connected || !read_pipe(pipe, &pid, sizeof(pid)) ||
+           !GetNamedPipeClientProcessId(pipe, &client_pid) || (pid != client_pid)){
+            CloseHandle(pipe);
+            continue;
+        }
+
+        // Server thread sends sockets between two loop iterations
+        _handoff_pipe = pipe;
+        _handoff_pid = client_pid;
+        _handoff_requested = true;
+        WakeServerThread();
+
+        // Failed handoff leaves server running, the next hot restart connects to a new pipe
+        while(_handoff_requested && _running){
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+    }
+
+    _handoff_finished = true;
+}
+
+void ServerHandler::AdoptHandoff(fd_set& master){
+    for(HandoffRecord& record : _inherited){
+        add_client_to_list(record.sock);
+
+        int client_index = find_client(record.sock);
+        if(client_index < 0){
+            closesocket(record.sock);
+            continue;
+        }
+
+        FD_SET(record.sock, &master);
+        set_socket_blocking(record.sock, 0);
+
+        if(_config.low_latency){
+            configure_low_latency_socket(record.sock, _config.busy_poll_us);
+        }
+
+        // Client keeps format negotiated with previous process
+        _client_list[client_index].codec = (frame_handler::frame_codec)record.codec;
+
+        size_t pos = 0;
+        string entry;
+
+        while(read_state_entry(record.state, pos, entry)){
+            if(entry.compare(0, 7, "OUTPUT ") == 0){
+                send_raw(client_index, entry.c_str() + 7, entry.size() - 7);
+            }
+            else if(entry.compare(0, 9, "CONFLATE ") == 0){
+                size_t topic_end = entry.find(' ', 9);
+                size_t expiry_end = (topic_end != string::npos) ? entry.find(' ', topic_end + 1) : string::npos;
+                uint64_t expiry_us = 0;
+
+                if((expiry_end != string::npos) &&
+                   parse_uint64(entry.substr(topic_end + 1, expiry_end - topic_end - 1), expiry_us)){
+                    // Steady clock is shared by both processes, expiry time stays valid
+                    str_queued_message& slot = _client_list[client_index].conflated_messages[entry.substr(9, topic_end - 9)];
+                    slot.data = entry.substr(expiry_end + 1);
+                    slot.expiry_us = expiry_us;
+                }
+            }
+            else if(entry.compare(0, 6, "INPUT ") == 0){
+                _input_readers[record.sock].Append(entry.c_str() + 6, entry.size() - 6);
+            }
+            else if(entry.compare(0, 4, "QOS ") == 0){
+                size_t topic_end = entry.find(' ', 4);
+                uint32_t next_seq = 0;
+
+                // Malformed entry is skipped
+                if((topic_end != string::npos) && parse_uint32(entry.substr(topic_end + 1), next_seq)){
+                    str_qos_subscription& sub = _client_list[client_index].qos_subscriptions[entry.substr(4, topic_end - 4)];
+                    sub.next_seq = next_seq;
+                    sub.sent_num = 0;
+                }
+            }
+            else if(entry.compare(0, 7, "QOSMSG ") == 0){
+                size_t topic_end = entry.find(' ', 7);
+                size_t seq_end = (topic_end != string::npos) ? entry.find(' ', topic_end + 1) : string::npos;
+
+                uint32_t seq = 0;
+
+                if((seq_end != string::npos) && parse_uint32(entry.substr(topic_end + 1, seq_end - topic_end - 1), seq)){
+                    string topic = entry.substr(7, topic_end - 7);
+
+                    _client_list[client_index].qos_subscriptions[topic].messages.push_back({seq, entry.substr(seq_end + 1)});
+                }
+            }
+            else{
+                // CONNECT and SUBSCRIBE restore client and its subscriptions on routers
+                HandleClientMessage(record.sock, entry);
+            }
+        }
+
+        // Messages that were not acknowledged are sent again, client drops duplicates
+        for(auto& sub : _client_list[client_index].qos_subscriptions){
+            send_qos_window(client_index, sub.second);
+        }
+    }
+
+    _inherited.clear();
+}
+
+bool ServerHandler::SendHandoff(const fd_set& master){
+    HANDLE pipe = _handoff_pipe;
+    bool ret = true;
+
+    _handoff_pipe = INVALID_HANDLE_VALUE;
+
+    // Complete deliveries first, so that only unsent output is handed over
+    DrainRouters();
+    DrainClients();
+
+    vector<SOCKET> sockets;
+    sockets.push_back(_listening);
+    for(int i = 0; i < kMaxClientNum; i++){
+        // Bridges are not handed over, peers connect to the new process again
+        if((_client_list[i].sock_handler != INVALID_SOCKET) && !_client_list[i].bridge_flag &&
+           FD_ISSET(_client_list[i].sock_handler, &master)){
+            sockets.push_back(_client_list[i].sock_handler);
+        }
+    }
+
+    for(SOCKET sock : sockets){
+        WSAPROTOCOL_INFO info;
+
+        if(WSADuplicateSocket(sock, _handoff_pid, &info) != 0){
+            cerr << "Can't duplicate socket, Err #" << WSAGetLastError() << endl;
+            ret = (sock != _listening);
+            if(!ret){
+                break;
+            }
+            continue;
+        }
+
+        int client_index = find_client(sock);
+        uint32_t kind = (sock == _listening) ? 1 : 2;
+        uint32_t codec = (client_index >= 0) ? (uint32_t)_client_list[client_index].codec : 0;
+        string state = (client_index >= 0) ? serialize_client_state(client_index) : string();
+        uint32_t length = (uint32_t)state.size();
+
+        if(!write_pipe(pipe, &kind, sizeof(kind)) || !write_pipe(pipe, &info, sizeof(info)) ||
+           !write_pipe(pipe, &codec, sizeof(codec)) || !write_pipe(pipe, &length, sizeof(length)) ||
+           !write_pipe(pipe, state.data(), state.size())){
+            ret = false;
+            break;
+        }
+    }
+
+    // End of handoff, new process fails without it
+    uint32_t kind = 0;
+    if(ret && write_pipe(pipe, &kind, sizeof(kind))){
+        FlushFileBuffers(pipe);
+    }
+    else{
+        ret = false;
+    }
+
+    CloseHandle(pipe);
+
+    if(!ret){
+        cerr << "Hot restart handoff failed, server keeps running" << endl;
+        _handoff_requested = false;
+        return false;
+    }
+
+    cout << "Sockets handed over to process " << _handoff_pid << endl;
+
+    return true;
+}
+
+void ServerHandler::DrainRouters(){
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_config.drain_ms);
+    int idle_count = 0;
+
+    // Router may be handling a command while its queues are empty, so idle is confirmed twice
+    while((idle_count < 2) && (std::chrono::steady_clock::now() < deadline)){
+        HandleRouterEvents();
+
+        bool idle = true;
+        for(auto& router : _routers){
+            idle = idle && router->Idle();
+        }
+
+        idle_count = idle ? (idle_count + 1) : 0;
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    HandleRouterEvents();
+}
+
+void ServerHandler::DrainClients(){
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_config.drain_ms);
+
+    while(1){
+        fd_set writeSet;
+        FD_ZERO(&writeSet);
+
+        for(int i = 0; i < kMaxClientNum; i++){
+            if(_client_list[i].sock_handler == INVALID_SOCKET){
+                continue;
+            }
+
+            flush_batch(i);
+            if(has_pending_output(i)){
+                FD_SET(_client_list[i].sock_handler, &writeSet);
+            }
+        }
+
+        if(writeSet.fd_count == 0){
+            break;
+        }
+
+        auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now());
+        if(remaining.count() <= 0){
+            cout << "Drain deadline expired, pending output dropped" << endl;
+            break;
+        }
+
+        timeval timeout;
+        timeout.tv_sec = (long)(remaining.count() / 1000000);
+        timeout.tv_usec = (long)(remaining.count() % 1000000);
+
+        if(select(0, nullptr, &writeSet, nullptr, &timeout) <= 0){
+            continue;
+        }
+
+        for(int i = 0; i < (int)writeSet.fd_count; i++){
+            int client_index = find_client(writeSet.fd_array[i]);
+
+            if(client_index >= 0){
+                flush_pending_output(client_index);
+            }
+        }
+    }
+}
+
+bool ServerHandler::InitializeWinSock(){
+    bool ret = true;
+
+	WSADATA wsData;
+	WORD ver = MAKEWORD(2, 2);
+
+	int wsOk = WSAStartup(ver, &wsData);
+	if (wsOk != 0)
+	{
+		cerr << "Can't Initialize winsock!" << endl;
+		ret = false;
+	}
+
+    return ret;
+}
+
+bool ServerHandler::CreateListeningSocket(){
+    bool ret = true;
+
+	// Create a listening socket
+	_listening = socket(AF_INET, SOCK_STREAM, 0);
+	if (_listening == INVALID_SOCKET)
+	{
+		cerr << "Can't create a socket" << endl;
+		return 0;
+	}
+
+    // Bind the ip address and port to a socket, port taken by another process fails initialization
+    sockaddr_in hint;
+    hint.sin_family = AF_INET;
+    hint.sin_port = htons(_port_num);
+    hint.sin_addr.S_un.S_addr = INADDR_ANY;
+
+    // Set socket for listening
+    if ((bind(_listening, (sockaddr*)&hint, sizeof(hint)) == SOCKET_ERROR) || (listen(_listening, SOMAXCONN) == SOCKET_ERROR))
+    {
+        cerr << "Can't listen on port " << _port_num << ", Err #" << WSAGetLastError() << endl;
+        closesocket(_listening);
+        _listening = INVALID_SOCKET;
+        ret = false;
+    }
+
+    return ret;
+}
+
+bool ServerHandler::CreateWakeSocket(){
+    // Routers send a datagram to this socket so that select() returns when deliveries are ready
+    _wake_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (_wake_sock == INVALID_SOCKET)
+    {
+        cerr << "Can't create a wake socket" << endl;
+        return false;
+    }
+
+    ZeroMemory(&_wake_addr, sizeof(_wake_addr));
+    _wake_addr.sin_family = AF_INET;
+    _wake_addr.sin_port = 0;
+    _wake_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int addr_size = sizeof(_wake_addr);
+    if ((bind(_wake_sock, (sockaddr*)&_wake_addr, sizeof(_wake_addr)) == SOCKET_ERROR) ||
+        (getsockname(_wake_sock, (sockaddr*)&_wake_addr, &addr_size) == SOCKET_ERROR))
+    {
+        cerr << "Can't bind a wake socket" << endl;
+        closesocket(_wake_sock);
+        return false;
+    }
+
+    set_socket_blocking(_wake_sock, 0);
+
+    return true;
+}
+
+void ServerHandler::RouteCommand(router_handler::router_command&& command){
+    if ((command.type == router_handler::ROUTE_REMOVE_CLIENT) || (command.type == router_handler::ROUTE_SUSPEND_CLIENT) ||
+        (command.type == router_handler::ROUTE_RESUME_CLIENT))
+    {
+        // Client may have subscriptions on every router
+        for (auto& router : _routers)
+        {
+            router_handler::router_command copy = command;
+            router->PushCommand(std::move(copy));
+        }
+
+        return;
+    }
+
+    _routers[_topic_hash.RouterFor(command.topic)]->PushCommand(std::move(command));
+}
+
+void ServerHandler::ConnectPeers(){
+    auto now = std::chrono::steady_clock::now();
+
+    for (str_peer& peer : _peers)
+    {
+        if ((peer.state != PEER_DOWN) || (now < peer.retry_time))
+        {
+            continue;
+        }
+
+        peer.retry_time = now + kPeerRetryInterval;
+
+        peer.sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (peer.sock == INVALID_SOCKET)
+        {
+            continue;
+        }
+
+        // Connect in background, select() reports result on write or except set
+        set_socket_blocking(peer.sock, 0);
+
+        if (_config.low_latency)
+        {
+            configure_low_latency_socket(peer.sock, _config.busy_poll_us);
+        }
+
+        if ((connect(peer.sock, (sockaddr*)&peer.addr, sizeof(peer.addr)) == SOCKET_ERROR) &&
+            (WSAGetLastError() != WSAEWOULDBLOCK))
+        {
+            closesocket(peer.sock);
+            peer.sock = INVALID_SOCKET;
+            continue;
+        }
+
+        peer.state = PEER_CONNECTING;
+    }
+}
+
+void ServerHandler::CheckPeerConnects(fd_set& writeSet, fd_set& exceptSet, fd_set& master){
+    for (str_peer& peer : _peers)
+    {
+        if (peer.state != PEER_CONNECTING)
+        {
+            continue;
+        }
+
+        if (FD_ISSET(peer.sock, &exceptSet))
+        {
+            // Peer is not running yet, try again later
+            closesocket(peer.sock);
+            peer.sock = INVALID_SOCKET;
+            peer.state = PEER_DOWN;
+            continue;
+        }
+
+        if (!FD_ISSET(peer.sock, &writeSet))
+        {
+            continue;
+        }
+
+        add_client_to_list(peer.sock);
+
+        int client_index = find_client(peer.sock);
+        if (client_index < 0)
+        {
+            closesocket(peer.sock);
+            peer.sock = INVALID_SOCKET;
+            peer.state = PEER_DOWN;
+            continue;
+        }
+
+        FD_SET(peer.sock, &master);
+        peer.state = PEER_CONNECTED;
+
+        // Bridge is a client of the peer, the peer answers with its own interest snapshot
+        _client_list[client_index].bridge_flag = 1;
+        send_message(client_index, "CONNECT NODE_" + to_string(_port_num) + " BRIDGE");
+        send_interest_snapshot(client_index);
+
+        cout << "Bridge connected to peer " << ntohs(peer.addr.sin_port) << endl;
+    }
+}
+
+bool ServerHandler::PollSockets(fd_set& readSet, fd_set& writeSet, fd_set& exceptSet){
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(_config.busy_poll_us);
+    timeval no_wait = {0, 0};
+
+    do
+    {
+        fd_set readCopy = readSet;
+        fd_set writeCopy = writeSet;
+        fd_set exceptCopy = exceptSet;
+
+        if (select(0, &readCopy, &writeCopy, &exceptCopy, &no_wait) > 0)
+        {
+            readSet = readCopy;
+            writeSet = writeCopy;
+            exceptSet = exceptCopy;
+            return true;
+        }
+
+        // Events are read directly from router queues, without waiting for wake-up datagram
+        for (auto& router : _routers)
+        {
+            if (router->HasEvents())
+            {
+                FD_ZERO(&readSet);
+                FD_ZERO(&writeSet);
+                FD_ZERO(&exceptSet);
+                return true;
+            }
+        }
+    } while (std::chrono::steady_clock::now() < deadline);
+
+    return false;
+}
+
+void ServerHandler::HandleRouterEvents(){
+    char wake[64];
+
+    // Drain wake-up datagrams, events are read from all routers anyway
+    while (recv(_wake_sock, wake, sizeof(wake), 0) > 0)
+    {
+    }
+
+    for (auto& router : _routers)
+    {
+        router_handler::router_event event;
+
+        // Rearm before reading, so that event pushed meanwhile wakes server thread again
+        router->ClearWake();
+
+        while (router->PopEvent(event))
+        {
+            if (event.type == router_handler::ROUTE_INTEREST)
+            {
+                // Routers report only the first and the last local subscriber of topic
+                if (event.interest_flag)
+                {
+                    _local_topics.insert(event.topic);
+                }
+                else
+                {
+                    _local_topics.erase(event.topic);
+                }
+
+                broadcast_interest(event.topic, event.interest_flag);
+                continue;
+            }
+
+            // Message expired while waiting in event queue
+            if ((event.type == router_handler::ROUTE_DELIVER) && is_expired(event.expiry_us))
+            {
+                continue;
+            }
+
+            string messageOut(event.message.c_str(), event.message.size() + 1);
+            string sharedFrame;
+            string bridgeOptions;
+
+            for (const router_handler::router_target& target : event.targets)
+            {
+                int i = find_client_by_id(target.client_id);
+
+                // Client disconnected after router resolved the targets, its session keeps the message
+                if (i < 0)
+                {
+                    auto session = _session_names.find(target.client_id);
+
+                    if ((session != _session_names.end()) && (event.type == router_handler::ROUTE_DELIVER))
+                    {
+                        buffer_missed_message(_sessions[session->second], target, event.topic, event.data, event.message,
+                                              event.expiry_us);
+                    }
+
+                    continue;
+                }
+
+                if (event.type == router_handler::ROUTE_CONTROL)
+                {
+                    send_message(i, event.message);
+                }
+                else if (_client_list[i].bridge_flag)
+                {
+                    // Peer server delivers message to all of its subscribers, so it is sent once per server
+                    if (bridgeOptions.empty())
+                    {
+                        bridgeOptions = format_publish_options(event.priority, event.expiry_us);
+                    }
+
+                    send_message(i, "PUBLISH " + event.topic + " " + event.data +
+                                    (bridgeOptions.empty() ? "" : " " + bridgeOptions), event.priority);
+                }
+                else if (target.qos_flag)
+                {
+                    deliver_qos_message(i, event.topic, event.data);
+                }
+                else
+                {
+                    deliver_message(i, event.topic, target.conflate_flag, messageOut, sharedFrame,
+                                    event.priority, event.expiry_us);
+                }
+            }
+        }
+    }
+}
+
+bool ServerHandler::HandleClientMessage(SOCKET sock, const string& message){
+    int client_index = find_client(sock);
+
+    if (message.compare("DISCONNECT") == 0)
+    {
+        // Send a message to the disconnected client
+        string DisconnectMsg = "CLIENT DISCONNECTED\n";
+
+        if (client_index >= 0)
+        {
+            send_message(client_index, DisconnectMsg);
+            flush_pending_output(client_index);
+        }
+        else
+        {
+            send(sock, DisconnectMsg.c_str(), DisconnectMsg.size() + 1, 0);
+        }
+
+        return false;
+    }
+
+    // Bridged peer confirms connection and shutdown like to any client
+    if ((client_index >= 0) && _client_list[client_index].bridge_flag &&
+        ((message.compare(0, 7, "CLIENT ") == 0) || (message.compare(0, 7, "SERVER ") == 0)))
+    {
+        return true;
+    }
+
+    // Parse input message before checking commands
+    parse_input_message(message);
+
+    router_handler::router_command command;
+    command.client_id = (client_index >= 0) ? _client_list[client_index].client_id : 0;
+    command.topic = _received_input_message.topicInput;
+    command.conflate_flag = 0;
+    command.shm_flag = 0;
+    command.qos_flag = 0;
+    command.bridge_flag = (client_index >= 0) ? _client_list[client_index].bridge_flag : 0;
+    command.priority = router_handler::PRIORITY_NORMAL;
+    command.expiry_us = 0;
+
+    // Convert string to enum so that switch-case could be performed
+    switch(resolveCommand(_received_input_message.commandInput))
+    {
+        case PUBLISH:
+        {
+            cout << "Publish command received" << endl;
+
+            // Optional time to live and priority class are last
+            if (!parse_publish_options(_received_input_message.flagInput, command))
+            {
+                cout << "Invalid publish options" << endl;
+                break;
+            }
+
+            // Router owning the topic delivers message to subscribers
+            command.type = router_handler::ROUTE_PUBLISH;
+            command.data = _received_input_message.dataInput;
+            RouteCommand(std::move(command));
+
+            break;
+        }
+        case SUBSCRIBE:
+        {
+            cout << "Subscribe command received" << endl;
+
+            if (client_index < 0)
+            {
+                cout << "Client not in client list" << endl;
+                break;
+            }
+
+            // Optional filter is sent as data, optional CONFLATE or QOS1 flag is last
+            string filter = _received_input_message.dataInput;
+            string flag = _received_input_message.flagInput;
+
+            if (flag.empty() && ((filter.compare("CONFLATE") == 0) || (filter.compare("QOS1") == 0)))
+            {
+                flag = filter;
+                filter.clear();
+            }
+
+            // Pending slot belongs to the previous subscription
+            _client_list[client_index].conflated_messages.erase(command.topic);
+
+            // Sequence numbers continue when acknowledged subscription is renewed
+            command.qos_flag = (flag.compare("QOS1") == 0) ? 1 : 0;
+            if (!command.qos_flag)
+            {
+                end_qos_subscription(client_index, command.topic);
+            }
+
+            // Subscribe client to specific topic, local subscriber may receive topic over shared memory
+            command.type = router_handler::ROUTE_SUBSCRIBE;
+            command.filter = filter;
+            command.conflate_flag = (flag.compare("CONFLATE") == 0) ? 1 : 0;
+            command.shm_flag = _client_list[client_index].shm_flag;
+            _client_list[client_index].subscribe_commands[command.topic] = message;
+            RouteCommand(std::move(command));
+
+            break;
+        }
+        case UNSUBSCRIBE:
+        {
+            cout << "Unsubscribe command received" << endl;
+
+            if (client_index < 0)
+            {
+                break;
+            }
+
+            _client_list[client_index].conflated_messages.erase(command.topic);
+            end_qos_subscription(client_index, command.topic);
+            _client_list[client_index].subscribe_commands.erase(command.topic);
+
+            // Unsubscribe client from specific topic
+            command.type = router_handler::ROUTE_UNSUBSCRIBE;
+            RouteCommand(std::move(command));
+
+            break;
+        }
+        case CONNECT:
+        {
+            cout << "Connect command received" << endl;
+
+            // Client name is sent as topic and capabilities as data
+            connect_client(sock, _received_input_message.topicInput, _received_input_message.dataInput);
+
+            if (client_index >= 0)
+            {
+                _client_list[client_index].connect_command = message;
+                ResumeSession(client_index);
+            }
+
+            break;
+        }
+        case ACK:
+        {
+            // Acknowledgement is cumulative, all messages of topic up to sequence number are received.
+            // Malformed acknowledgement is ignored
+            uint32_t seq = 0;
+
+            if ((client_index >= 0) && parse_uint32(_received_input_message.dataInput, seq))
+            {
+                acknowledge_qos_messages(client_index, command.topic, seq);
+            }
+
+            break;
+        }
+        case INTEREST:
+        {
+            if ((client_index < 0) || !_client_list[client_index].bridge_flag)
+            {
+                cout << "Interest received from client that is not a bridge" << endl;
+                break;
+            }
+
+            // Peer has subscribers of topic, bridge is subscribed on its behalf
+            command.type = (_received_input_message.dataInput.compare("+") == 0) ?
+                           router_handler::ROUTE_SUBSCRIBE : router_handler::ROUTE_UNSUBSCRIBE;
+            RouteCommand(std::move(command));
+
+            break;
+        }
+        default:
+        {
+            cout << "Unknown command" << endl;
+        }
+    }
+
+    return true;
+}
+
+void ServerHandler::ResumeSession(int client_index){
+    auto it = _sessions.find(_client_list[client_index].client_name);
+
+    if ((it == _sessions.end()) || _client_list[client_index].bridge_flag)
+    {
+        return;
+    }
+
+    str_session& session = it->second;
+
+    // Subscriptions made before CONNECT are replaced by the ones of the session
+    router_handler::router_command command;
+    command.type = router_handler::ROUTE_REMOVE_CLIENT;
+    command.client_id = _client_list[client_index].client_id;
+    RouteCommand(std::move(command));
+
+    _client_list[client_index].client_id = session.client_id;
+    _client_list[client_index].qos_subscriptions.swap(session.qos_subscriptions);
+    _client_list[client_index].subscribe_commands.swap(session.subscribe_commands);
+
+    // Shared memory rings are announced again to the new connection
+    router_handler::router_command resume;
+    resume.type = router_handler::ROUTE_RESUME_CLIENT;
+    resume.client_id = session.client_id;
+    resume.shm_flag = _client_list[client_index].shm_flag;
+    RouteCommand(std::move(resume));
+
+    // Messages that outlived their time to live while client was disconnected are not sent
+    deque<str_queued_message> missed_messages;
+    for (str_queued_message& message : session.missed_messages)
+    {
+        if (!is_expired(message.expiry_us))
+        {
+            missed_messages.push_back(std::move(message));
+        }
+    }
+
+    for (auto slot = session.conflated_messages.begin(); slot != session.conflated_messages.end();)
+    {
+        slot = is_expired(slot->second.expiry_us) ? session.conflated_messages.erase(slot) : std::next(slot);
+    }
+
+    send_message(client_index, "SESSION RESUMED, " + to_string(missed_messages.size() + session.conflated_messages.size()) +
+                               " missed messages, " + to_string(session.dropped_num) + " dropped\n");
+
+    for (const str_queued_message& message : missed_messages)
+    {
+        send_message(client_index, message.data, router_handler::PRIORITY_NORMAL, message.expiry_us);
+    }
+
+    for (const auto& message : session.conflated_messages)
+    {
+        send_message(client_index, message.second.data, router_handler::PRIORITY_NORMAL, message.second.expiry_us);
+    }
+
+    // Messages that were not acknowledged before connection was lost are retransmitted
+    for (auto& sub : _client_list[client_index].qos_subscriptions)
+    {
+        send_qos_window(client_index, sub.second);
+    }
+
+    _session_names.erase(session.client_id);
+    _sessions.erase(it);
+
+    cout << "Session resumed" << endl;
+}
+
+void ServerHandler::ExpireSessions(){
+    auto now = std::chrono::steady_clock::now();
+
+    for (auto it = _sessions.begin(); it != _sessions.end();)
+    {
+        if (now < it->second.expiry_time)
+        {
+            ++it;
+            continue;
+        }
+
+        router_handler::router_command command;
+        command.type = router_handler::ROUTE_REMOVE_CLIENT;
+        command.client_id = it->second.client_id;
+        RouteCommand(std::move(command));
+
+        _session_names.erase(it->second.client_id);
+        it = _sessions.erase(it);
+
+        cout << "Session expired" << endl;
+    }
+}
+
+void ServerHandler::CloseClient(SOCKET sock, fd_set& master, bool end_session){
+    int client_index = find_client(sock);
+
+    if (_capture.IsOpen() && (client_index >= 0))
+    {
+        _capture.Record(_client_list[client_index].connection_id, capture_handler::CAPTURE_DISCONNECT);
+    }
+
+    // Lost connection keeps session, subscriptions of client are dropped on all routers when session ends
+    if (client_index >= 0)
+    {
+        if (end_session || !detach_session(client_index, _config.session_expiry))
+        {
+            router_handler::router_command command;
+            command.type = router_handler::ROUTE_REMOVE_CLIENT;
+            command.client_id = _client_list[client_index].client_id;
+            RouteCommand(std::move(command));
+        }
+        else
+        {
+            // Shared memory subscriptions continue from the ring position of lost connection
+            router_handler::router_command command;
+            command.type = router_handler::ROUTE_SUSPEND_CLIENT;
+            command.client_id = _client_list[client_index].client_id;
+            RouteCommand(std::move(command));
+
+            cout << "Session kept for " << _config.session_expiry << " seconds" << endl;
+        }
+    }
+
+    remove_client_from_list(sock);
+    _input_readers.erase(sock);
+
+    // Lost outgoing bridge is reconnected
+    for (str_peer& peer : _peers)
+    {
+        if (peer.sock == sock)
+        {
+            peer.sock = INVALID_SOCKET;
+            peer.state = PEER_DOWN;
+            peer.retry_time = std::chrono::steady_clock::now() + kPeerRetryInterval;
+        }
+    }
+
+    closesocket(sock);
+    FD_CLR(sock, &master);
+}
+
+void ServerHandler::ServerThread(){
+    bool handed_off = false;
+
+	// Create file descriptor and zero it
+	fd_set master;
+	FD_ZERO(&master);
+
+	// Add listening and wake socket to file descriptor
 	FD_SET(_listening, &master);
+	FD_SET(_wake_sock, &master);
     
-    // Initialize client subscribe list
-    initialize_client_subscribe_list();
+    // Initialize client list
+    initialize_client_list();
+
+    // Server thread gets its own CPU, routers were started with affinity that excludes it
+    if (_config.io_cpu >= 0)
+    {
+        SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << _config.io_cpu);
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+    }
+
+    // Clients of previous process continue on their connections
+    AdoptHandoff(master);
 
-	while (1)
+	while (_running)
 	{
+        // New process took over, sockets are handed over between two loop iterations
+        if (_handoff_requested && SendHandoff(master))
+        {
+            handed_off = true;
+            break;
+        }
+
 		// Make a copy of descriptor file because select() call is destructive
 		fd_set copy = master;
         
-        // Call select() 
-		int socketCount = select(0, &copy, nullptr, nullptr, nullptr);
+        // Wait for writability only on clients with pending output
+        fd_set writeSet;
+        FD_ZERO(&writeSet);
+        for (int i = 0; i < kMaxClientNum; i++)
+        {
+            if ((_client_list[i].sock_handler != INVALID_SOCKET) && has_pending_output(i))
+            {
+                FD_SET(_client_list[i].sock_handler, &writeSet);
+            }
+        }
+        
+        // Peers that are not connected yet are retried periodically
+        ConnectPeers();
+
+        fd_set exceptSet;
+        FD_ZERO(&exceptSet);
+        int peer_pending = 0;
+        for (const str_peer& peer : _peers)
+        {
+            if (peer.state == PEER_CONNECTING)
+            {
+                FD_SET(peer.sock, &writeSet);
+                FD_SET(peer.sock, &exceptSet);
+            }
+
+            if (peer.state != PEER_CONNECTED)
+            {
+                peer_pending = 1;
+            }
+        }
+
+        timeval timeout;
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+        
+        // Call select(), it wakes up periodically while peers are connecting or sessions wait for expiry.
+        // In low latency mode sockets are polled first and blocking wait is used only when nothing arrives
+        if (!_config.low_latency || !PollSockets(copy, writeSet, exceptSet))
+        {
+            if (select(0, &copy, &writeSet, &exceptSet, (peer_pending || !_sessions.empty()) ? &timeout : nullptr) == SOCKET_ERROR)
+            {
+                // Sets are not updated on error, none of the sockets is known to be ready
+                cerr << "Select failed, Err #" << WSAGetLastError() << endl;
+                FD_ZERO(&copy);
+                FD_ZERO(&writeSet);
+                FD_ZERO(&exceptSet);
+            }
+        }
+
+        CheckPeerConnects(writeSet, exceptSet, master);
 
 		// Loop through all the current connections
-		for (int i = 0; i < socketCount; i++)
+		for (int i = 0; i < (int)copy.fd_count; i++)
 		{
 			SOCKET sock = copy.fd_array[i];
 
-			// Check is it a listening or a client socket
+			// Check is it a listening, wake or a client socket
 			if (sock == _listening)
 			{
 				// Accept new connection
 				SOCKET client = accept(_listening, nullptr, nullptr);
 
+				if (client == INVALID_SOCKET)
+				{
+					cerr << "Can't accept connection, Err #" << WSAGetLastError() << endl;
+					continue;
+				}
+
 				// Add the new connection to the list of connected clients
 				FD_SET(client, &master);
                 
-                // Add the new client to the subscribe list
-                add_client_to_subscribe_list(client);
+                // Slow client must never block the server thread, its output is buffered instead
+                set_socket_blocking(client, 0);
+
+                if (_config.low_latency)
+                {
+                    configure_low_latency_socket(client, _config.busy_poll_us);
+                }
+
+                // Add the new client to the client list
+                add_client_to_list(client);
+
+                if (_capture.IsOpen())
+                {
+                    _capture.Record(find_connection_id(client), capture_handler::CAPTURE_CONNECT);
+                }
 
 				// Send a message to the connected client
 				string ConnectMsg = "CLIENT CONNECTED\n";
-				send(client, ConnectMsg.c_str(), ConnectMsg.size() + 1, 0);
+				int client_index = find_client(client);
+				if (client_index >= 0)
+				{
+					send_message(client_index, ConnectMsg);
+				}
+				else
+				{
+					send(client, ConnectMsg.c_str(), ConnectMsg.size() + 1, 0);
+				}
+			}
+			else if (sock == _wake_sock)
+			{
+				// Router events are handled after all sockets
+				continue;
 			}
 			else
 			{
 				char bufInput[4096];
-				ZeroMemory(bufInput, 4096);
 				
 				// Receive message
 				int bytesIn = recv(sock, bufInput, 4096, 0);
                 
+				// Non-blocking socket may report readiness without data
+				if ((bytesIn == SOCKET_ERROR) && (WSAGetLastError() == WSAEWOULDBLOCK))
+				{
+					continue;
+				}
+
 				if (bytesIn <= 0)
 				{
-					// Close client
-					closesocket(sock);
-					FD_CLR(sock, &master);
+					// Close client, connection is lost so session is kept
+					CloseClient(sock, master, false);
+					continue;
 				}
-                else if(strcmp(bufInput, "DISCONNECT") == 0)
-                {
-                    // Send a message to the disconnected client
-                    string DisconnectMsg = "CLIENT DISCONNECTED\n";
-                    send(sock, DisconnectMsg.c_str(), DisconnectMsg.size() + 1, 0);
                     
-                    // Remove client from subscribe list
-                    remove_client_from_subscribe_list(sock);
+				// Commands may arrive together or split between reads
+				frame_handler::FrameReader &reader = _input_readers[sock];
+				string message;
+				int closed = 0;
+                    
+				reader.Append(bufInput, bytesIn);
             
-                    // Disconnect the client
-                    closesocket(sock);
-                    FD_CLR(sock, &master);
-                }
-				else
+				while (reader.Next(message))
 				{
-                    string buf = bufInput;
-                    string publish_topic;
-                    int publish_flag = 0;
-                    
-                    // Parse input message before checking commands
-                    parse_input_message(buf);
-                    
-                    // Convert string to enum so that switch-case could be performed 
-                    switch(resolveCommand(_received_input_message.commandInput))
-                    {
-                        case PUBLISH:
-                        {
-                            cout << "Publish command received" << endl;
-                            
-                            // Set publish flag and add publish topic 
-                            publish_flag = 1;
-                            publish_topic = _received_input_message.topicInput;
-                            
-                            break;
-                        }
-                        case SUBSCRIBE:
-                        {
-                            cout << "Subscribe command received" << endl;
-                            
-                            // Subscribe client to specific topic 
-                            subscribe(sock, _received_input_message.topicInput);
-                            
-                            break;
-                        }
-                        case UNSUBSCRIBE:
-                        {
-                            cout << "Unsubscribe command received" << endl;
-                            
-                            // Unsubscribe client from specific topic
-                            unsubscribe(sock, _received_input_message.topicInput);
-                            
-                            break;
-                        }
-                        default:
-                        {
-                            cout << "Unknown command" << endl;
-                        }
-                    }
+					// Commands are captured as parsed, so replay sees the same message boundaries
+					if (_capture.IsOpen())
+					{
+						_capture.Record(find_connection_id(sock), capture_handler::CAPTURE_MESSAGE, message);
+					}
 
-					// Check if there are messages waiting to be published to a specific topic and socket
-					for (int i = 0; i < (int)master.fd_count; i++)
+					if (!HandleClientMessage(sock, message))
 					{
-						SOCKET outSock = master.fd_array[i];
-
-                        // Check publish flag status and whether any client subscribed to publish topic
-                        if (is_client_subscribed_to_publish_topic(outSock, publish_topic) && publish_flag)
-						{
-							ostringstream ss;
-                            ss << "[Message] Topic: " << publish_topic << " Data: " << _received_input_message.dataInput << endl;
-                            
-							string strOut = ss.str();
-							send(outSock, strOut.c_str(), strOut.size() + 1, 0);
-                            
-                            // Clear publish flag and topic
-                            publish_flag = 0;
-                            publish_topic.clear();
-						}
+						// Disconnect the client, it ended its session
+						CloseClient(sock, master, true);
+						closed = 1;
+						break;
 					}
 				}
+
+				// Command without terminating null character would grow input buffer without bound
+				if (!closed && (reader.PendingSize() > kMaxCommandSize))
+				{
+					cout << "Command too long, closing client" << endl;
+					CloseClient(sock, master, true);
+				}
 			}
 		}
+        
+        // Deliver messages resolved by routers
+        HandleRouterEvents();
+
+        ExpireSessions();
+
+        // Send messages batched during this loop
+        for (int i = 0; i < kMaxClientNum; i++)
+        {
+            if (_client_list[i].sock_handler != INVALID_SOCKET)
+            {
+                flush_batch(i);
+            }
+        }
+        
+        // Send buffered output and latest conflated messages to clients whose socket drained
+        for (int i = 0; i < (int)writeSet.fd_count; i++)
+        {
+            int client_index = find_client(writeSet.fd_array[i]);
+
+            if (client_index >= 0)
+            {
+                flush_pending_output(client_index);
+            }
+        }
 	}
 
+    // Clients are told about shutdown and get their pending output before sockets are closed.
+    // After handoff sockets stay open in the new process, only handles of this process are closed
+    if (!handed_off)
+    {
+        DrainRouters();
+
+        for (int i = 0; i < kMaxClientNum; i++)
+        {
+            if (_client_list[i].sock_handler != INVALID_SOCKET)
+            {
+                send_message(i, "SERVER SHUTDOWN\n");
+            }
+        }
+
+        DrainClients();
+    }
+
 	while (master.fd_count > 0)
 	{
 		// Get the socket
@@ -480,6 +2707,19 @@ void ServerHandler::ServerThread(){
 		FD_CLR(sock, &master);
 		closesocket(sock);
 	}
+
+    for (str_peer& peer : _peers)
+    {
+        if (peer.state == PEER_CONNECTING)
+        {
+            closesocket(peer.sock);
+        }
+    }
+
+    _capture.Close();
+
+    _running = false;
+    cout << "Server stopped" << endl;
 }
 
-} // namespace server_handler
\ No newline at end of file
+} // namespace server_handler
@@ -7,15 +7,52 @@
 
 #pragma once
 
+#include <atomic>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <string>
 #include <WS2tcpip.h>
 #include <thread>
+#include <vector>
+
+#include "capture.h"
+#include "router.h"
 
 using namespace std;
 
 namespace server_handler {
 
+struct ServerConfig
+{
+    // Number of router threads topics are partitioned between
+    int router_num = 2;
+    // Servers to bridge to, host:port or port on localhost
+    std::vector<std::string> peers;
+    // Seconds subscriptions of disconnected client are kept, 0 disables sessions
+    int session_expiry = 60;
+    // Busy-poll sockets and router queues before blocking, TCP_NODELAY on all client sockets
+    bool low_latency = false;
+    // Microseconds server thread polls before it blocks in select()
+    int busy_poll_us = 50;
+    // CPU reserved for server thread, -1 disables pinning
+    int io_cpu = -1;
+    // Milliseconds pending output is sent to clients on shutdown
+    int drain_ms = 2000;
+    // Take over listening socket, clients and subscriptions of running server on the same port
+    bool hot_restart = false;
+    // File inbound commands are captured to, empty disables capture
+    std::string capture_path;
+};
+
+struct HandoffRecord
+{
+    SOCKET sock;
+    int codec;
+    // Null separated commands that restore client state
+    std::string state;
+};
+
 class ServerHandler {
  public:
   /**
@@ -32,10 +69,23 @@ class ServerHandler {
    * @brief Initializes Server handler.
    * 
    * @param [in] port_num - port number
+   * @param [in] config - server configuration
    *
    * @return bool - True on success, false otherwise.
    */
-  bool Init(int port_num);
+  bool Init(int port_num, const ServerConfig& config = ServerConfig());
+
+  /**
+   * @brief Stop server thread, pending output is sent to clients until drain deadline.
+   */
+  void Shutdown();
+
+  /**
+   * @brief Check if server thread is running, it stops on shutdown or after hot restart handoff.
+   *
+   * @return bool - true if server is running, false otherwise.
+   */
+  bool IsRunning() const;
 
  private:
   /**
@@ -52,13 +102,148 @@ class ServerHandler {
    */
   bool CreateListeningSocket();
 
+  /**
+   * @brief Receive listening socket, clients and their state from running server.
+   *
+   * @return bool - true on success, false otherwise.
+   */
+  bool ReceiveHandoff();
+
+  /**
+   * @brief Handoff Thread waiting for new server process that takes over on hot restart.
+   */
+  void HandoffThread();
+
+  /**
+   * @brief Add clients received on hot restart to client list and restore their subscriptions.
+   *
+   * @param [in,out] master - file descriptor set of server thread
+   */
+  void AdoptHandoff(fd_set& master);
+
+  /**
+   * @brief Duplicate listening and client sockets for new server process and send state of clients.
+   *
+   * @param [in] master - file descriptor set of server thread
+   *
+   * @return bool - true on success, false otherwise.
+   */
+  bool SendHandoff(const fd_set& master);
+
+  /**
+   * @brief Deliver events of commands routers are still handling.
+   */
+  void DrainRouters();
+
+  /**
+   * @brief Send pending output to clients until all is sent or drain deadline expires.
+   */
+  void DrainClients();
+
+  /**
+   * @brief Wake server thread blocked in select().
+   */
+  void WakeServerThread();
+
+  /**
+   * @brief Create UDP socket used by routers to wake server thread.
+   *
+   * @return bool - true on success, false otherwise.
+   */
+  bool CreateWakeSocket();
+
+  /**
+   * @brief Forward command to router owning the topic, client removal is sent to all routers.
+   *
+   * @param [in] command - router command
+   */
+  void RouteCommand(router_handler::router_command&& command);
+
+  /**
+   * @brief Start connecting to peers that are not connected, each peer is retried after interval.
+   */
+  void ConnectPeers();
+
+  /**
+   * @brief Complete peer connections reported by select() and start bridges.
+   *
+   * @param [in] writeSet - sockets reported writable
+   * @param [in] exceptSet - sockets reported failed
+   * @param [in,out] master - file descriptor set of server thread
+   */
+  void CheckPeerConnects(fd_set& writeSet, fd_set& exceptSet, fd_set& master);
+
+  /**
+   * @brief Poll sockets and router queues without blocking for configured time.
+   *
+   * @param [in,out] readSet - sockets to check for reading, sockets ready for reading on return
+   * @param [in,out] writeSet - sockets to check for writing, sockets ready for writing on return
+   * @param [in,out] exceptSet - sockets to check for errors, failed sockets on return
+   *
+   * @return bool - true if sockets are ready or router events are waiting, false if poll time expired.
+   */
+  bool PollSockets(fd_set& readSet, fd_set& writeSet, fd_set& exceptSet);
+
+  /**
+   * @brief Send messages resolved by routers to clients.
+   */
+  void HandleRouterEvents();
+
+  /**
+   * @brief Handle single message received from client.
+   *
+   * @param [in] sock - client socket
+   * @param [in] message - message without terminating null character
+   *
+   * @return bool - false if client disconnected, true otherwise.
+   */
+  bool HandleClientMessage(SOCKET sock, const string& message);
+
+  /**
+   * @brief Resume session of client that connected with name of disconnected session.
+   *
+   * @param [in] client_index - index in client list
+   */
+  void ResumeSession(int client_index);
+
+  /**
+   * @brief Remove subscriptions of sessions that were not resumed before expiry.
+   */
+  void ExpireSessions();
+
+  /**
+   * @brief Close client socket, subscriptions are kept in session if connection was lost.
+   *
+   * @param [in] sock - client socket
+   * @param [in,out] master - file descriptor set of server thread
+   * @param [in] end_session - true if client disconnected on purpose
+   */
+  void CloseClient(SOCKET sock, fd_set& master, bool end_session);
+
   /**
    * @brief Server Thread for listening message from client.
    */
   void ServerThread();
 
   SOCKET _listening;
+  SOCKET _wake_sock;
+  sockaddr_in _wake_addr;
   std::thread _server_thread;
+  std::atomic<bool> _running{false};
+
+  // Hot restart, new process connects to pipe of running process
+  std::thread _handoff_thread;
+  HANDLE _handoff_pipe = INVALID_HANDLE_VALUE;
+  std::atomic<bool> _handoff_requested{false};
+  std::atomic<bool> _handoff_finished{false};
+  DWORD _handoff_pid = 0;
+  std::vector<HandoffRecord> _inherited;
+
+  capture_handler::CaptureWriter _capture;
+
+  ServerConfig _config;
+  std::vector<std::unique_ptr<router_handler::RouterHandler>> _routers;
+  router_handler::ConsistentHash _topic_hash;
 
   int _port_num;
 };
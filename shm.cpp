@@ -0,0 +1,198 @@
+/**
+ ***********************************************************************
+ * @file   shm.cpp
+ * @author Juraj Grabovac (jgrabovac2@gmail.com)
+ * @date   19/10/2026
+ * @brief  See shm.h
+ ***********************************************************************
+*/
+
+
+/*----- Includes -----*/
+#include "shm.h"
+
+namespace shm_transport {
+
+namespace {
+
+/*----- Helper Functions -----*/
+/**
+ * @brief Find sequence number of the oldest message that is still valid after consumer was lapped.
+ *        Slot of write sequence may be overwritten right now, so reading continues one slot after it.
+ *
+ * @param [in] read_seq - sequence number of message that could not be read
+ * @param [in] write_seq - sequence number of the next written message
+ *
+ * @return uint64_t - sequence number to continue reading from.
+ */
+uint64_t resume_seq_after_overrun(uint64_t read_seq, uint64_t write_seq)
+{
+    uint64_t resume_seq = (write_seq >= kShmSlotNum) ? (write_seq - kShmSlotNum + 1) : 0;
+
+    // Reading always moves forward, otherwise the same slot would be reported again
+    return (resume_seq > read_seq) ? resume_seq : (read_seq + 1);
+}
+
+}  // namespace
+
+ShmRing::~ShmRing() {
+    Close();
+}
+
+bool ShmRing::Create(const std::string& name){
+    size_t size = sizeof(ring_header) + kShmSlotNum * sizeof(ring_slot);
+
+    _mapping = CreateFileMapping(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, (DWORD)size, name.c_str());
+    if(_mapping == nullptr){
+        return false;
+    }
+
+    if(!Map(FILE_MAP_ALL_ACCESS)){
+        return false;
+    }
+
+    // Segment of a previous server instance may still be attached, continue its sequence
+    if(_header->slot_num == 0){
+        _header->write_seq.store(0, std::memory_order_relaxed);
+        _header->slot_num = kShmSlotNum;
+        _header->slot_size = kShmSlotSize;
+    }
+
+    return true;
+}
+
+bool ShmRing::Open(const std::string& name, uint64_t start_seq){
+    Close();
+
+    _mapping = OpenFileMapping(FILE_MAP_READ, FALSE, name.c_str());
+    if(_mapping == nullptr){
+        return false;
+    }
+
+    if(!Map(FILE_MAP_READ)){
+        return false;
+    }
+
+    if((_header->slot_num != kShmSlotNum) || (_header->slot_size != kShmSlotSize)){
+        Close();
+        return false;
+    }
+
+    // Messages written between announcement and attach are read too, reading can not start in the future
+    uint64_t write_seq = _header->write_seq.load(std::memory_order_acquire);
+    _read_seq = (start_seq < write_seq) ? start_seq : write_seq;
+
+    return true;
+}
+
+void ShmRing::Close(){
+    if(_header != nullptr){
+        UnmapViewOfFile(_header);
+        _header = nullptr;
+        _slots = nullptr;
+    }
+
+    if(_mapping != nullptr){
+        CloseHandle(_mapping);
+        _mapping = nullptr;
+    }
+}
+
+bool ShmRing::Write(const char *data, size_t length){
+    if((_header == nullptr) || (length > kShmSlotSize)){
+        return false;
+    }
+
+    uint64_t seq = _header->write_seq.load(std::memory_order_relaxed);
+    ring_slot& slot = _slots[seq % kShmSlotNum];
+
+    // Mark slot as being written so that lapped consumers detect torn read
+    slot.state.store(2 * seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    memcpy(slot.data, data, length);
+    slot.length = (uint32_t)length;
+
+    slot.state.store(2 * seq + 2, std::memory_order_release);
+    _header->write_seq.store(seq + 1, std::memory_order_release);
+
+    return true;
+}
+
+uint64_t ShmRing::WriteSeq() const{
+    if(_header == nullptr){
+        return 0;
+    }
+
+    return _header->write_seq.load(std::memory_order_acquire);
+}
+
+shm_read_result ShmRing::Read(std::string& message){
+    if(_header == nullptr){
+        return SHM_READ_EMPTY;
+    }
+
+    uint64_t write_seq = _header->write_seq.load(std::memory_order_acquire);
+    if(_read_seq == write_seq){
+        return SHM_READ_EMPTY;
+    }
+
+    // Consumer is more than one ring behind, oldest messages are already overwritten
+    if(write_seq - _read_seq > kShmSlotNum){
+        _read_seq = write_seq - kShmSlotNum;
+        return SHM_READ_OVERRUN;
+    }
+
+    const ring_slot& slot = _slots[_read_seq % kShmSlotNum];
+
+    uint64_t state = slot.state.load(std::memory_order_acquire);
+    if(state != 2 * _read_seq + 2){
+        _read_seq = resume_seq_after_overrun(_read_seq, write_seq);
+        return SHM_READ_OVERRUN;
+    }
+
+    uint32_t length = slot.length;
+    if(length > kShmSlotSize){
+        length = kShmSlotSize;
+    }
+    message.assign(slot.data, length);
+
+    // Slot was overwritten while it was copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(slot.state.load(std::memory_order_relaxed) != state){
+        _read_seq = resume_seq_after_overrun(_read_seq, _header->write_seq.load(std::memory_order_acquire));
+        return SHM_READ_OVERRUN;
+    }
+
+    _read_seq++;
+
+    return SHM_READ_MESSAGE;
+}
+
+std::string ShmRing::SegmentName(int port_num, const std::string& topic){
+    std::string name = "Local\\pubsub_" + std::to_string(port_num) + "_" + topic;
+
+    // Backslash is reserved in kernel object names
+    for(size_t i = 6; i < name.size(); ++i){
+        if(name[i] == '\\'){
+            name[i] = '_';
+        }
+    }
+
+    return name;
+}
+
+bool ShmRing::Map(DWORD access){
+    void *view = MapViewOfFile(_mapping, access, 0, 0, 0);
+    if(view == nullptr){
+        Close();
+        return false;
+    }
+
+    _header = (ring_header *)view;
+    _slots = (ring_slot *)((char *)view + sizeof(ring_header));
+
+    return true;
+}
+
+}  // namespace shm_transport
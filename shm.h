@@ -0,0 +1,140 @@
+/**
+ * @file shm.h
+ *
+ * @brief Implementation of shared memory transport for same-host clients.
+ *
+ * Every topic delivered over shared memory has one ring buffer in a named
+ * file mapping. The server is the single producer and writes each message
+ * once, every local subscriber of the topic is a consumer with its own
+ * read position. Ring never blocks the producer, a consumer that falls
+ * more than one ring behind skips the overwritten messages.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <WS2tcpip.h>
+
+namespace shm_transport {
+
+constexpr uint32_t kShmSlotNum = 256;
+constexpr uint32_t kShmSlotSize = 4608;
+
+enum shm_read_result
+{
+    SHM_READ_EMPTY,
+    SHM_READ_MESSAGE,
+    SHM_READ_OVERRUN
+};
+
+class ShmRing {
+ public:
+  /**
+   * @brief Constructor
+   */
+  ShmRing() = default;
+
+  /**
+   * @brief Destructor
+   */
+  ~ShmRing();
+
+  ShmRing(const ShmRing&) = delete;
+  ShmRing& operator=(const ShmRing&) = delete;
+
+  /**
+   * @brief Create ring buffer as producer.
+   *
+   * @param [in] name - shared memory segment name
+   *
+   * @return bool - true on success, false otherwise.
+   */
+  bool Create(const std::string& name);
+
+  /**
+   * @brief Attach to ring buffer as consumer, previously attached ring is closed.
+   *
+   * @param [in] name - shared memory segment name
+   * @param [in] start_seq - sequence number of the first message to read, announced by server
+   *
+   * @return bool - true on success, false otherwise.
+   */
+  bool Open(const std::string& name, uint64_t start_seq);
+
+  /**
+   * @brief Detach from ring buffer.
+   */
+  void Close();
+
+  /**
+   * @brief Write message to ring buffer, only single producer is allowed.
+   *
+   * @param [in] data - message
+   * @param [in] length - message length
+   *
+   * @return bool - true on success, false if message is longer than slot.
+   */
+  bool Write(const char *data, size_t length);
+
+  /**
+   * @brief Get sequence number of the next written message.
+   *
+   * @return uint64_t - write sequence number, 0 if ring is not attached.
+   */
+  uint64_t WriteSeq() const;
+
+  /**
+   * @brief Read next message from ring buffer.
+   *
+   * @param [out] message - read message
+   *
+   * @return shm_read_result - SHM_READ_MESSAGE if message is read, SHM_READ_EMPTY if there is
+   *                           no new message, SHM_READ_OVERRUN if messages were overwritten before read.
+   */
+  shm_read_result Read(std::string& message);
+
+  /**
+   * @brief Build segment name for topic of server listening on port.
+   *
+   * @param [in] port_num - server port number
+   * @param [in] topic - topic
+   *
+   * @return std::string - segment name.
+   */
+  static std::string SegmentName(int port_num, const std::string& topic);
+
+ private:
+  struct ring_header
+  {
+      std::atomic<uint64_t> write_seq;
+      uint32_t slot_num;
+      uint32_t slot_size;
+  };
+
+  struct ring_slot
+  {
+      // Odd while slot is written, 2 * seq + 2 when message seq is complete
+      std::atomic<uint64_t> state;
+      uint32_t length;
+      char data[kShmSlotSize];
+  };
+
+  /**
+   * @brief Map segment to process memory.
+   *
+   * @param [in] access - map access flags
+   *
+   * @return bool - true on success, false otherwise.
+   */
+  bool Map(DWORD access);
+
+  HANDLE _mapping = nullptr;
+  ring_header *_header = nullptr;
+  ring_slot *_slots = nullptr;
+  uint64_t _read_seq = 0;
+};
+
+}  // namespace shm_transport
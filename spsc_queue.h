@@ -0,0 +1,97 @@
+/**
+ * @file spsc_queue.h
+ *
+ * @brief Implementation of bounded lock-free single producer single consumer queue.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace spsc_queue {
+
+template <typename T>
+class SpscQueue {
+ public:
+  /**
+   * @brief Constructor
+   *
+   * @param [in] capacity - queue capacity, rounded up to power of two
+   */
+  explicit SpscQueue(size_t capacity) {
+    size_t size = 1;
+
+    while (size < capacity) {
+      size <<= 1;
+    }
+
+    _items.resize(size);
+    _mask = size - 1;
+  }
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  /**
+   * @brief Push item to queue, may be called only from producer thread.
+   *
+   * @param [in] item - item to push
+   *
+   * @return bool - true on success, false if queue is full.
+   */
+  bool Push(T&& item) {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+
+    if (tail - _head.load(std::memory_order_acquire) > _mask) {
+      return false;
+    }
+
+    _items[tail & _mask] = std::move(item);
+    _tail.store(tail + 1, std::memory_order_seq_cst);
+
+    return true;
+  }
+
+  /**
+   * @brief Pop item from queue, may be called only from consumer thread.
+   *
+   * @param [out] item - popped item
+   *
+   * @return bool - true on success, false if queue is empty.
+   */
+  bool Pop(T& item) {
+    size_t head = _head.load(std::memory_order_relaxed);
+
+    if (head == _tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    item = std::move(_items[head & _mask]);
+    _head.store(head + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  /**
+   * @brief Check if queue is empty.
+   *
+   * @return bool - true if queue is empty, false otherwise.
+   */
+  bool Empty() const {
+    return _head.load(std::memory_order_seq_cst) == _tail.load(std::memory_order_seq_cst);
+  }
+
+ private:
+  std::vector<T> _items;
+  size_t _mask;
+
+  // Consumer and producer positions on separate cache lines
+  alignas(64) std::atomic<size_t> _head{0};
+  alignas(64) std::atomic<size_t> _tail{0};
+};
+
+}  // namespace spsc_queue